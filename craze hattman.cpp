@@ -1,18 +1,58 @@
 ﻿#include "raylib.h"
+#include "rlgl.h"
+#include <assert.h>
 #include <math.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
-
-#define WIDTH 800
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define USE_SSE2 1
+#endif
+
+#define WIDTH 800                    // Окно
 #define HEIGHT 600
+#define WORLD_WIDTH 2400             // Арена, по которой едет камера
+#define WORLD_HEIGHT 1800
+#define CULL_MARGIN 50               // Запас на подписи и короны над врагами
+#define ENEMY_FAR_MARGIN 300         // Дальше от вида преследователь идёт грубым шагом
+#define ENEMY_FAR_PERIOD 4           // Тиков между шагами дальнего врага
+#define ENEMY_CONTACT_COOLDOWN 30    // Тиков между ударами врага касанием
 #define MAX_BULLETS 100
-#define MAX_ENEMIES 50
+#define MAX_ENEMIES 500              // На арене толпа на порядок больше, чем влезала в окно
 #define MAX_BONUSES 10
 #define MAX_KNIVES 50
-#define MAX_BOSS_BULLETS 50
-#define MAX_ENEMY_BULLETS 30  // Пули обычных врагов
+// Пули летят до края арены (диагональ 3000 px): при скорости 5 спираль
+// босса (8 пуль за 20 тиков) держит в воздухе до 240 пуль, стрелок при
+// скорости 4 и залпе раз в 90 тиков - до 9
+#define MAX_BOSS_BULLETS 256
+#define MAX_ENEMY_BULLETS 256 // Пули обычных врагов
+
+#define SIM_TICK_RATE 60             // Частота симуляции, тиков/сек
+#define SIM_DT (1.0 / SIM_TICK_RATE)
+#define SIM_MAX_CATCHUP 5            // Больше тиков за кадр не догоняем
+#define RENDER_FPS 60                // Целевая частота кадров по умолчанию (--fps)
+#define PACER_MIN_SPIN 0.0002        // Минимальный запас на кручение перед дедлайном, сек
+#define PACER_MAX_SPIN 0.004
+#define PACING_BUCKETS 100           // Корзины ошибки по 20 мкс, последняя - переполнение
+#define PACING_BUCKET_US 20.0
+#define JOB_MAX_WORKERS 8            // Рабочие потоки помимо главного
+#define JOB_DEQUE_SIZE 256           // Степень двойки
+#define JOB_MAX_PHASES 16
+#define JOB_MAX_DEPENDENTS 4
+#define JOB_PARALLEL_MIN 512         // Меньше элементов - фаза идёт одним куском
+#define JOB_CHUNK 256
+#define COLLISION_HITS_PER_WORKER 2048
+#define COLLISION_MERGED_SIZE (MAX_ENEMIES * MAX_BULLETS)  // Все возможные пары враг/пуля
+#define COLLISION_CHUNK 8            // Врагов/ножей в одном куске поиска столкновений
+#define INPUT_QUEUE_SIZE 1024        // Степень двойки
+#define INPUT_SAMPLE_INTERVAL 0.001  // Опрос ввода во время ожидания кадра, сек
 
 // Структура кнопки
 typedef struct {
@@ -23,47 +63,63 @@ typedef struct {
     Color currentColor;
 } Button;
 
+// ХЭНДЛЫ СУЩНОСТЕЙ
+// Сущности лежат плотными массивами, но удаление переставляет элементы.
+// Слот-карта даёт каждой сущности постоянный слот, а поколение слота
+// растёт при удалении, так что старый хэндл просто перестаёт находиться.
+#define SLOT_MAP_CAPACITY 512
+
+typedef struct {
+    unsigned short slot;
+    unsigned short generation;  // 0 - пустой хэндл
+} EntityHandle;
+
 // Структура ножа
 typedef struct {
     float x, y;
+    float prevX, prevY;  // Позиция на прошлом тике, для интерполяции при отрисовке
     float speed;
     float radius;
     Color color;
     float directionAngle;
     float distanceTraveled;
     float maxDistance;
+    EntityHandle target;  // Враг, за которым доворачивает нож
+    float turnRate;       // Радиан за тик
 } Knife;
 
 // Структура бонуса
 typedef struct {
     float x, y;
+    float prevX, prevY;
     float width, height;
     Color color;
     float speed;
     bool collected;
-    int lifetime;
+    int lifetime;       // Тиков до исчезновения, отсчитывает колесо таймеров
     char bonusType[20];
 } HatBonus;
 
 // Структура игрока
 typedef struct {
     float x, y;
+    float prevX, prevY;
     float radius;
     float speed;
     Color color;
     int health;
     int lives;
-    bool invincible;
-    int invincibleTimer;
-    int damageMultiplier;
-    int bonusTimer;
+    bool invincible;         // Снимает таймер колеса
+    int damageMultiplier;    // Сбрасывает таймер колеса
     bool hasKnifeBonus;
-    int shootCooldown;
+    bool hasLaser;           // Снимает таймер колеса
+    int shootReadyTick;      // Тик колеса, с которого можно стрелять
 } Player;
 
 // Структура пули
 typedef struct {
     float x, y;
+    float prevX, prevY;
     float radius;
     float speed;
     Color color;
@@ -71,29 +127,107 @@ typedef struct {
     float dx, dy;
 } Bullet;
 
+// Снаряд, летящий по прямой: позиция считается по формуле от тика вылета,
+// а не интегрируется каждый тик. Тик исчезновения известен сразу.
+#define PROJECTILE_MIN_SPEED 0.5f
+
+typedef struct {
+    float originX, originY;  // Точка вылета
+    float dx, dy;            // Единичное направление
+    float speed;             // Скорость до первого шага
+    float accel;             // Прирост скорости за тик
+    int launchTick;          // Тик колеса, после которого начинается движение
+    int despawnTick;         // Первый тик, когда снаряд за краем арены
+} Projectile;
+
 // Структура пули босса
 typedef struct {
-    float x, y;
+    Projectile motion;
     float radius;
-    float speed;
     Color color;
     int damage;
-    float dx, dy;
 } BossBullet;
 
 // Структура пули врага
 typedef struct {
-    float x, y;
+    Projectile motion;
     float radius;
-    float speed;
     Color color;
     int damage;
-    float dx, dy;
 } EnemyBullet;
 
+// ПАТТЕРНЫ ПУЛЬ
+// Атаки описываются коротким текстом и при запуске компилируются в байткод.
+// Направления веера считаются один раз в общую таблицу, а при выстреле
+// поворачиваются на угол излучателя - один sin/cos на залп, не на пулю.
+//   speed V [A] - скорость новых пуль и прирост скорости за тик
+//   ring N [OFFSET] - N пуль по кругу, первая под углом OFFSET
+//   fan N ARC [CENTER] - N пуль в секторе ARC градусов вокруг CENTER
+//   aim - развернуть излучатель на игрока
+//   rotate DEG, angle DEG - повернуть излучатель / задать угол
+//   wait T - ждать T тиков
+//   repeat N ... end - повторить N раз (0 - бесконечно)
+// В конце программа начинается заново.
+#define PATTERN_MAX_OPS 64
+#define PATTERN_MAX_DEPTH 4
+#define PATTERN_MAX_DIRECTIONS 4096
+#define PATTERN_MAX_STEPS 256        // Операций за запуск без wait
+
+typedef enum {
+    PATTERN_OP_SPEED,   // value - скорость, accel - прирост за тик
+    PATTERN_OP_EMIT,    // count пуль по направлениям table
+    PATTERN_OP_AIM,
+    PATTERN_OP_ROTATE,  // value - радианы
+    PATTERN_OP_ANGLE,   // value - радианы
+    PATTERN_OP_WAIT,    // count - тики
+    PATTERN_OP_REPEAT,  // count - раз, 0 - бесконечно
+    PATTERN_OP_END      // jump - первая операция тела цикла
+} PatternOpcode;
+
+typedef struct {
+    unsigned char op;
+    short count;
+    short jump;
+    int table;          // Начало направлений в таблице библиотеки
+    float value;
+    float accel;
+} PatternOp;
+
+typedef struct {
+    const char* name;
+    PatternOp ops[PATTERN_MAX_OPS];
+    int opCount;
+} BulletPattern;
+
+typedef enum {
+    PATTERN_BOSS_WAVE,
+    PATTERN_BOSS_SPIRAL,
+    PATTERN_BOSS_TARGETED,
+    PATTERN_SHOOTER_AIMED,
+    PATTERN_COUNT
+} PatternId;
+
+typedef struct {
+    BulletPattern patterns[PATTERN_COUNT];
+    Vector2 directions[PATTERN_MAX_DIRECTIONS];
+    int directionCount;
+} PatternLibrary;
+
+// Исполнение паттерна конкретным врагом
+typedef struct {
+    unsigned char pattern;  // PatternId
+    unsigned char pc;
+    unsigned char depth;
+    short loopLeft[PATTERN_MAX_DEPTH];
+    float angle;            // Радианы
+    float speed;
+    float accel;
+} PatternState;
+
 // Структура врага
 typedef struct {
     float x, y;
+    float prevX, prevY;
     float radius;
     float speed;
     Color color;
@@ -107,13 +241,1168 @@ typedef struct {
     bool isTank;      // Танк
     bool isRunner;    // Бегун
     float dx, dy;
-    int attackCooldown;
-    int shootCooldown;
+    int attackReadyTick;  // Тик колеса, с которого враг снова бьёт при касании
+    int lastThinkTick;    // Тик колеса последнего решения ИИ, -1 - ещё не думал
+    int shootCooldown;    // Задержка выстрела после остановки
+    float stopY;          // Где босс и стрелок встают (верх вида при появлении + отступ)
     bool hasStopped;
+    bool isFar;           // Далеко от вида: грубый шаг, без расталкивания
     int attackPattern;
-    int attackTimer;
+    PatternState pattern;
 } Enemy;
 
+// Поле направлений к игроку: одно на всех преследующих врагов
+#define FLOW_CELL 25
+#define FLOW_COLS (WORLD_WIDTH / FLOW_CELL)
+#define FLOW_ROWS (WORLD_HEIGHT / FLOW_CELL)
+#define FLOW_DIRECT_RANGE 2  // Ближе стольких клеток к игроку враг целится напрямую
+
+typedef struct {
+    Vector2 direction;  // Единичный вектор из центра клетки
+    int stamp;          // Сборка, для которой клетка досчитана
+} FlowCell;
+
+typedef struct {
+    FlowCell cells[FLOW_ROWS][FLOW_COLS];
+    Vector2 target;                            // Игрок на момент сборки
+    int targetCol, targetRow;                  // Клетка игрока при последней сборке
+    int builds;                                // Смен клетки игрока
+    long long cellsBuilt;                      // Клеток досчитано по запросу
+    long long lookups;
+    long long direct;                          // Врагов рядом с игроком, нормировка напрямую
+} FlowField;
+
+// Замер поля против нормировки каждым врагом для --bench
+#define FLOW_BENCH_TICKS 2000
+
+typedef struct {
+    int enemies;
+    double flowUsPerTick;       // Смена сборки + досчёт клеток + выборки
+    double directUsPerTick;     // Старый путь: sqrt на каждого врага
+    double cellsPerTick;
+    float maxError;             // Худшее расхождение направлений
+} FlowBench;
+
+// ПЛАНИРОВЩИК ИИ
+// Решения врагов (куда идти) дорогие и нужны не каждый тик. Каждый тик враг
+// только движется по последнему решению, а сами решения раздаются по
+// приоритету в пределах бюджета: сначала те, кто рядом с игроком и на экране.
+#define AI_BUDGET_US 500.0           // Бюджет решений на тик, мкс
+#define AI_MAX_THINKS 4096           // Решений за тик при любом бюджете
+#define AI_NEAR_RADIUS 150.0f
+#define AI_NEAR_PERIOD 1             // Тиков между решениями рядом с игроком
+#define AI_SCREEN_PERIOD 4           // На экране
+#define AI_OFFSCREEN_PERIOD 12       // За экраном
+#define AI_STARVE_PERIODS 2          // Просрочил столько периодов - в первый ярус
+#define AI_TIER_COUNT 3              // Рядом или заждался, на экране, за экраном
+#define AI_BUDGET_CHECK 8            // Решений между чтениями часов
+
+typedef struct {
+    int index;
+    int tier;
+} AiCandidate;
+
+typedef struct {
+    double budgetUs;
+    bool timeBudget;                 // false - только AI_MAX_THINKS (бенчмарк, повторяемость)
+    AiCandidate candidates[MAX_ENEMIES];
+    int order[MAX_ENEMIES];          // Индексы кандидатов, разложенные по ярусам
+    int lastThinks;
+    int lastDeferred;
+} AiScheduler;
+
+// Архетипы врагов (для профайлера)
+typedef enum {
+    ARCHETYPE_REGULAR,
+    ARCHETYPE_RUNNER,
+    ARCHETYPE_SHOOTER,
+    ARCHETYPE_TANK,
+    ARCHETYPE_ELITE,
+    ARCHETYPE_BOSS,
+    ARCHETYPE_COUNT
+} EnemyArchetype;
+
+const char* archetypeNames[ARCHETYPE_COUNT] = { "regular", "runner", "shooter", "tank", "elite", "boss" };
+
+#define PROFILER_WINDOW 60  // Кадров в окне усреднения оверлея
+
+// Статистика точности кадрового пейсера
+typedef struct {
+    double targetHz;
+    int buckets[PACING_BUCKETS + 1];
+    int frames;
+    int missed;         // Кадр начат позже следующего дедлайна
+    double sumError;    // Опоздание начала кадра, мкс
+    double maxError;
+    double spinTime;    // Сек, потраченные на кручение
+    double spinMargin;  // Текущий запас на кручение, мкс
+    double wakeJitter;  // Оценка пересыпа планировщика, мкс
+} PacingStats;
+
+// Затраты одного архетипа
+typedef struct {
+    double updateTime;     // UpdateEnemy, сек
+    double collisionTime;  // Проверки столкновений, сек
+    double drawTime;       // DrawEnemy, сек
+    double thinkTime;      // Решения ИИ, сек
+    long long enemyTicks;  // Сумма "враг x тик"
+    long long enemyDraws;  // Сумма "враг x кадр"
+    long long thinks;      // Решений ИИ
+    int spawned;
+} ArchetypeCost;
+
+// Структура профайлера
+typedef struct {
+    bool showOverlay;
+    ArchetypeCost current[ARCHETYPE_COUNT];  // Текущее окно
+    ArchetypeCost shown[ARCHETYPE_COUNT];    // Последнее полное окно (оверлей)
+    ArchetypeCost total[ARCHETYPE_COUNT];    // За всё время (JSON)
+    double tickTime;
+    double shownTickTime;
+    double totalTickTime;
+    double aiTime;            // Планировщик ИИ целиком, сек
+    double shownAiTime;
+    double totalAiTime;
+    double particleTime;      // Частицы: обновление и отрисовка, сек
+    double shownParticleTime;
+    double totalParticleTime;
+    long long culledDraws;    // Сущностей, не нарисованных камерой
+    long long farEnemyTicks;  // Вражеских тиков по грубому пути
+    long long nearEnemyTicks;
+    long long aiDeferred;     // Решений, отложенных из-за бюджета
+    long long shownAiDeferred;
+    long long totalAiDeferred;
+    int windowTicks;
+    int shownTicks;
+    long long totalTicks;
+    int windowFrames;
+    long long totalFrames;
+    PacingStats pacing;
+} Profiler;
+
+#define LATENCY_MAX_PENDING 32
+#define LATENCY_BUCKETS 200      // Корзины по 0.5 мс, последняя - переполнение
+#define LATENCY_BUCKET_MS 0.5
+#define LATENCY_TIMEOUT 0.5      // Сек: неотработанное событие выбрасывается
+
+// Типы отслеживаемых событий ввода
+typedef enum {
+    INPUT_EVENT_FIRE,
+    INPUT_EVENT_KNIVES,
+    INPUT_EVENT_MOVE,
+    INPUT_EVENT_TYPE_COUNT
+} InputEventType;
+
+// Событие ввода на пути "опрос -> тик -> кадр"
+typedef struct {
+    InputEventType type;
+    double sampleTime;   // Опрос ввода (конец прошлого EndDrawing)
+    double consumeTime;  // Тик, который отработал событие
+    bool consumed;
+} LatencyEvent;
+
+typedef struct {
+    int buckets[LATENCY_BUCKETS + 1];
+    int count;
+    double sum;
+    double max;
+} LatencyHistogram;
+
+// Структура замера задержки ввода
+typedef struct {
+    bool enabled;
+    LatencyEvent pending[LATENCY_MAX_PENDING];
+    int pendingCount;
+    LatencyHistogram sampleToSim;
+    LatencyHistogram simToPresent;
+    LatencyHistogram total;
+} LatencyTracker;
+
+// Кнопки ввода, которые видит симуляция
+typedef enum {
+    INPUT_LEFT,
+    INPUT_RIGHT,
+    INPUT_UP,
+    INPUT_DOWN,
+    INPUT_FIRE,              // ЛКМ
+    INPUT_KNIVES,            // ПКМ
+    INPUT_BACK,              // ESC
+    INPUT_TOGGLE_PROFILER,   // F3
+    INPUT_TOGGLE_LATENCY,    // F4
+    INPUT_TOGGLE_SEPARATION, // F5
+    INPUT_BUTTON_COUNT
+} InputButton;
+
+#define INPUT_BIT(button) (1u << (button))
+
+// Снимок ввода с меткой времени
+typedef struct {
+    double time;
+    Vector2 mouse;
+    unsigned int buttons;
+} InputSample;
+
+// Lock-free SPSC очередь снимков ввода.
+// Сейчас и пишет, и читает главный поток: GLFW разрешает опрос событий только
+// из него. Атомики оставлены, чтобы производителя можно было вынести в поток
+// ввода на платформах без этого ограничения; одновременного доступа сейчас нет.
+typedef struct {
+    InputSample ring[INPUT_QUEUE_SIZE];
+    std::atomic<unsigned int> head;  // Пишет производитель
+    std::atomic<unsigned int> tail;  // Пишет потребитель
+
+    // Состояние производителя
+    InputSample lastPushed;
+    int dropped;
+
+    // Состояние потребителя
+    unsigned int held;
+    Vector2 mouse;
+} InputQueue;
+
+// Ввод одного тика симуляции
+typedef struct {
+    unsigned int held;     // Зажато на конец тика
+    unsigned int pressed;  // Нажато за тик (даже если уже отпущено)
+    double pressTime[INPUT_BUTTON_COUNT];
+    Vector2 aim;           // Мышь на конец тика
+    Vector2 fireAim;       // Мышь в момент нажатия ЛКМ
+} TickInput;
+
+// Кадровый пейсер: сон почти до дедлайна, затем кручение на монотонных часах
+typedef struct {
+    double period;
+    double nextDeadline;
+    double spinMargin;  // Сколько до дедлайна крутимся, сек
+    double wakeJitter;  // Пересып планировщика (быстрый рост, медленный спад), сек
+} FramePacer;
+
+// Обработка диапазона [begin, end) элементов фазы; worker - индекс потока (0 - главный)
+typedef void (*JobFunc)(void* data, int begin, int end, int worker);
+
+typedef struct JobPhase JobPhase;
+
+typedef struct {
+    JobPhase* phase;
+    int begin;
+    int end;
+} Job;
+
+// Дек задач потока: владелец работает с низа, воры крадут сверху.
+// Это не Chase-Lev: top/bottom защищены спинлоком на весь дек. Задач за тик
+// десятки, спор за лок редкий, а без CAS-протокола нет ABA и тонкостей с порядком памяти
+typedef struct {
+    Job jobs[JOB_DEQUE_SIZE];
+    int top;
+    int bottom;
+    std::atomic<bool> locked;
+} JobDeque;
+
+// Фаза графа: запускается, когда завершены все фазы, от которых она зависит
+struct JobPhase {
+    const char* name;
+    JobFunc func;
+    void* data;
+    int count;
+    int minParallel;  // Порог параллельного выполнения
+    int chunkSize;
+    int dependents[JOB_MAX_DEPENDENTS];
+    int dependentCount;
+    int dependencyCount;
+    std::atomic<int> remainingJobs;
+    std::atomic<int> pendingDependencies;
+};
+
+typedef struct {
+    JobPhase phases[JOB_MAX_PHASES];
+    int phaseCount;
+    std::atomic<int> remainingPhases;
+} JobGraph;
+
+// Планировщик задач с кражей работы; дек 0 принадлежит главному потоку
+typedef struct {
+    int workerCount;
+    JobDeque deques[JOB_MAX_WORKERS + 1];
+    std::thread threads[JOB_MAX_WORKERS];
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::atomic<int> generation;  // Растёт при каждой новой порции задач
+    std::atomic<bool> quit;
+    JobGraph* graph;              // Граф, который сейчас выполняется
+} JobSystem;
+
+// Пара пересекающихся объектов: first - враг (или нож), second - пуля (или враг)
+typedef struct {
+    int first;
+    int second;
+} HitPair;
+
+// Буферы попаданий: каждый поток пишет в свой, потом слияние по порядку
+typedef struct {
+    HitPair bulletHits[JOB_MAX_WORKERS + 1][COLLISION_HITS_PER_WORKER];
+    int bulletHitCount[JOB_MAX_WORKERS + 1];
+    HitPair knifeHits[JOB_MAX_WORKERS + 1][COLLISION_HITS_PER_WORKER];
+    int knifeHitCount[JOB_MAX_WORKERS + 1];
+    bool overflowed[JOB_MAX_WORKERS + 1];
+    int tests[JOB_MAX_WORKERS + 1][ARCHETYPE_COUNT];
+    HitPair merged[COLLISION_MERGED_SIZE];
+} CollisionBuffers;
+
+static_assert(MAX_ENEMIES * MAX_BULLETS <= COLLISION_MERGED_SIZE, "merged hit buffer must hold every enemy/bullet pair");
+static_assert(MAX_KNIVES * MAX_ENEMIES <= COLLISION_MERGED_SIZE, "merged hit buffer must hold every knife/enemy pair");
+static_assert((JOB_MAX_WORKERS + 1) * COLLISION_HITS_PER_WORKER <= COLLISION_MERGED_SIZE, "merged hit buffer must hold every worker buffer");
+
+// Пространственный индекс врагов: хэш клеток, собирается сортировкой подсчётом.
+// Запросы только читают его и обходят не больше ENEMY_QUERY_MAX_RINGS колец клеток.
+#define ENEMY_INDEX_CELL 70
+#define ENEMY_INDEX_BUCKETS 1024     // Степень двойки
+#define ENEMY_INDEX_MAX_RADIUS 50    // Самый крупный враг (босс)
+#define ENEMY_QUERY_MAX_RINGS 8      // Дальность запросов - до 8 клеток
+#define ENEMY_QUERY_MAX_K 16
+
+#define ENEMY_RAY_MAX_CELLS 64      // Клеток на один луч
+#define ENEMY_RAY_SWEEP_LIMIT 256   // До стольких врагов проще пройти весь массив
+
+typedef struct {
+    int bucketStart[ENEMY_INDEX_BUCKETS + 1];
+    int entries[MAX_ENEMIES];        // Индексы врагов, по корзинам
+    int cellX[MAX_ENEMIES], cellY[MAX_ENEMIES];
+    // Копия позиций в порядке entries: корзина - непрерывный кусок для SIMD
+    alignas(16) float entryX[MAX_ENEMIES + 4];
+    alignas(16) float entryY[MAX_ENEMIES + 4];
+    alignas(16) float entryRadius[MAX_ENEMIES + 4];
+    int count;                       // Врагов на момент сборки
+    int builds;
+} EnemyIndex;
+
+// Попадание луча: враг и расстояние от начала луча до входа в его круг
+typedef struct {
+    int enemy;
+    float distance;
+} RayHit;
+
+// Лазер игрока за последний тик
+#define LASER_RANGE 1000.0f
+#define LASER_DAMAGE 1               // За тик по каждому задетому врагу
+#define LASER_DURATION 360           // Тиков
+
+typedef struct {
+    bool firing;
+    Vector2 aim;
+    Vector2 origin;
+    Vector2 direction;
+    RayHit hits[MAX_ENEMIES];
+    int hitCount;
+} LaserBeam;
+
+// Замер лучей на синтетической толпе для --bench
+#define RAYCAST_BENCH_RAYS 20000
+
+typedef struct {
+    int rays;
+    double usPerRay;
+    double cellsUsPerRay;            // Обход клеток при любой толпе
+    double bruteUsPerRay;            // Перебор всех врагов без индекса
+    double hitsPerRay;
+    int mismatches;                  // Лучи, где индекс и перебор разошлись
+} RaycastBench;
+
+// Сверка запросов к индексу с перебором на той же толпе
+#define QUERY_BENCH_POINTS 20000
+
+typedef struct {
+    int points;
+    double usPerPoint;               // Все три запроса через индекс
+    double bruteUsPerPoint;
+    int radiusMismatches;
+    int nearestMismatches;
+    int coneMismatches;
+} QueryBench;
+
+// ЧАСТИЦЫ
+// Пул в виде отдельных массивов по полям: обновление идёт по 4 частицы
+// за раз, отрисовка - одной серией треугольников без отдельных вызовов на
+// частицу. Живых не больше budget; с заполнением пула эмиттеры выпускают
+// всё меньше частиц, чтобы бюджет не упирался в одну большую вспышку.
+#define MAX_PARTICLES 50000
+#define PARTICLE_LOD_START 0.5f      // Доля бюджета, с которой эмиттеры урезаются
+#define PARTICLE_DRAG 0.94f
+#define PARTICLE_GRAVITY 0.08f
+#define PARTICLE_DRAW_CHUNK 1024     // Частиц между проверками буфера отрисовки
+#define PARTICLE_BENCH_FRAMES 120
+#define PARTICLE_FRAME_BUDGET_US 1000.0
+
+typedef struct {
+    alignas(16) float x[MAX_PARTICLES];
+    alignas(16) float y[MAX_PARTICLES];
+    alignas(16) float vx[MAX_PARTICLES];
+    alignas(16) float vy[MAX_PARTICLES];
+    alignas(16) float life[MAX_PARTICLES];   // 1 - только вылетела, 0 - погасла
+    alignas(16) float decay[MAX_PARTICLES];  // Убыль life за тик
+    alignas(16) float size[MAX_PARTICLES];
+    Color color[MAX_PARTICLES];
+    int count;
+    int budget;
+    unsigned int seed;     // Свой генератор: эффекты не сбивают сид игры
+    int peak;
+    long long emitted;
+    long long dropped;     // Срезано бюджетом и LOD
+} ParticleSystem;
+
+// Замер пула, заполненного до предела, для --bench
+typedef struct {
+    double liveAvg;
+    double updateUs;       // За кадр
+    double drawUs;         // Вершины и отправка пачки
+    double frameUs;        // Весь кадр вместе с EndDrawing
+} ParticleBench;
+
+// УРОВНИ КАЧЕСТВА
+// Регулятор следит за временем работы кадра (без ожидания пейсера) и при
+// угрозе бюджету снимает детали врагов и HUD по ступеням. Вниз - быстро,
+// вверх - только после долгого запаса и паузы, чтобы не мигать.
+typedef enum {
+    QUALITY_FULL,
+    QUALITY_NO_TEXT,     // Без здоровья и подписей над врагами
+    QUALITY_SIMPLE,      // Без лиц, рук, ног и снаряжения
+    QUALITY_MINIMAL,     // Без контуров и корон, только тела
+    QUALITY_TIER_COUNT
+} QualityTier;
+
+const char* qualityNames[QUALITY_TIER_COUNT] = { "FULL", "NO TEXT", "SIMPLE", "MINIMAL" };
+const int qualityParticleBudgets[QUALITY_TIER_COUNT] = { MAX_PARTICLES, 20000, 8000, 2000 };
+
+#define QUALITY_SMOOTHING 0.1        // Вес нового кадра в среднем
+#define QUALITY_DOWN_SHARE 0.85      // Доля бюджета кадра, выше которой снижаем
+#define QUALITY_UP_SHARE 0.5         // Доля, ниже которой можно вернуть ступень
+#define QUALITY_DOWN_FRAMES 15       // Кадров подряд над порогом
+#define QUALITY_UP_FRAMES 120        // Кадров подряд под порогом
+#define QUALITY_COOLDOWN 60          // Кадров без смен после смены
+
+typedef struct {
+    QualityTier tier;
+    double budget;       // Сек на кадр
+    double average;      // Сглаженное время работы кадра
+    int overFrames;
+    int underFrames;
+    int cooldown;
+    int changes;
+    long long framesAtTier[QUALITY_TIER_COUNT];
+} QualityGovernor;
+
+// ВНУТРЕННЕЕ РАЗРЕШЕНИЕ
+// Кадр рисуется в текстуру WIDTH*scale x HEIGHT*scale и одним растяжением
+// выводится в окно любого размера. Логика, HUD и мышь остаются в координатах
+// WIDTH x HEIGHT, так что заливка зависит только от scale, а не от дисплея.
+#define RENDER_SCALE_MIN 0.25f
+#define RENDER_SCALE_MAX 4.0f
+// Доля базового масштаба на ступени качества
+const float qualityRenderScales[QUALITY_TIER_COUNT] = { 1.0f, 1.0f, 0.75f, 0.5f };
+
+typedef struct {
+    RenderTexture2D target;
+    float baseScale;     // Задан --render-scale
+    float scale;         // С учётом ступени качества
+    bool integerScale;   // Растягивать в целое число раз без сглаживания
+    Rectangle dest;      // Куда кадр ложится в окне
+    int resizes;         // Пересозданий текстуры
+} Presenter;
+
+// Расталкивание толпы: соседи преследователя берутся из индекса врагов
+#define SEPARATION_MAX_PUSH 1.0f     // Предел суммарного толчка, в радиусах врага
+#define SEPARATION_SLICE 512         // Врагов за тик, остальные ждут следующего
+#define SEPARATION_STRENGTH 0.5f     // Доля перекрытия, снимаемая за тик
+#define SEPARATION_ACTIVE_MARGIN 200 // Дальше от вида толпа не расталкивается
+
+typedef struct {
+    bool enabled;
+    Vector2 push[MAX_ENEMIES];
+    int cursor;                      // С кого начнётся следующий срез
+    int sliceBegin, sliceCount;
+    long long neighborTests[JOB_MAX_WORKERS + 1];
+} SeparationGrid;
+
+// Слот-карта одного массива сущностей
+typedef struct {
+    unsigned short denseOf[SLOT_MAP_CAPACITY];     // Слот -> индекс в массиве
+    unsigned short slotOf[SLOT_MAP_CAPACITY];      // Индекс в массиве -> слот
+    unsigned short generation[SLOT_MAP_CAPACITY];
+    unsigned short freeSlots[SLOT_MAP_CAPACITY];
+    int freeCount;
+    int count;                                     // Элементов со слотом
+} SlotMap;
+
+static_assert(MAX_BULLETS <= SLOT_MAP_CAPACITY && MAX_ENEMIES <= SLOT_MAP_CAPACITY &&
+    MAX_KNIVES <= SLOT_MAP_CAPACITY && MAX_BONUSES <= SLOT_MAP_CAPACITY &&
+    MAX_BOSS_BULLETS <= SLOT_MAP_CAPACITY && MAX_ENEMY_BULLETS <= SLOT_MAP_CAPACITY,
+    "slot map must cover every entity array");
+
+// КОЛЕСО ТАЙМЕРОВ
+// Иерархическое колесо: 4 уровня по 64 корзины покрывают 64^4 тиков.
+// Таймер кладётся в корзину по сроку и за всю жизнь переезжает не больше
+// трёх раз, а тик стоит только тех таймеров, что сработали. Время колеса
+// идёт лишь в тиках игры, поэтому в меню и между уровнями таймеры стоят.
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_BUCKETS (TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS + 1)  // Последняя - сработавшие
+#define TIMER_FIRED_BUCKET (TIMER_BUCKETS - 1)
+#define TIMER_MAX_DELAY ((1u << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1)
+#define TIMER_MAX 32768
+
+typedef enum {
+    TIMER_PLAYER_INVINCIBLE,  // Конец неуязвимости после удара
+    TIMER_PLAYER_BONUS,       // Конец бонуса урона
+    TIMER_PLAYER_LASER,       // Конец лазера
+    TIMER_SHOOTER_FIRE,       // Выстрел стрелка
+    TIMER_BOSS_FIRE,          // Залп босса
+    TIMER_BOSS_PATTERN,       // Смена атаки босса
+    TIMER_BONUS_EXPIRE,       // Бонус исчезает
+    TIMER_ENEMY_SPAWN,        // Появление врага
+    TIMER_BONUS_SPAWN,        // Попытка выбросить бонус
+    TIMER_BOSS_BULLET_EXPIRE, // Пуля босса улетела за край
+    TIMER_ENEMY_BULLET_EXPIRE,
+    TIMER_TYPE_COUNT
+} TimerType;
+
+typedef struct {
+    unsigned short index;
+    unsigned short generation;  // 0 - пустой хэндл
+} TimerHandle;
+
+typedef struct {
+    unsigned int expires;
+    int next, prev;             // Список корзины
+    int bucket;                 // -1 - свободен
+    unsigned short generation;
+    unsigned char type;         // TimerType
+    EntityHandle target;        // Сущность, к которой привязан таймер
+} Timer;
+
+typedef struct {
+    Timer timers[TIMER_MAX];
+    int head[TIMER_BUCKETS];
+    int tail[TIMER_BUCKETS];
+    int freeHead;
+    unsigned int now;
+    int active;
+    long long scheduled;
+    long long fired;
+    long long cascaded;
+} TimerWheel;
+
+// ИГРОВЫЕ СОБЫТИЯ
+// Фазы тика только находят, что произошло, и пишут события. Урон, очки,
+// бонусы и смена состояния применяются одним шагом в порядке очереди.
+typedef enum {
+    GAME_EVENT_HIT,              // Пуля или нож попали во врага
+    GAME_EVENT_KILL,             // Враг убит
+    GAME_EVENT_PLAYER_DAMAGED,   // Игрок получил удар
+    GAME_EVENT_BONUS_COLLECTED,  // Игрок подобрал бонус
+    GAME_EVENT_BOSS_DEFEATED,    // Босс последнего уровня убит
+    GAME_EVENT_LEVEL_COMPLETE,   // Набрано нужное число убийств
+    GAME_EVENT_BOSS_SPAWNED,     // Появился босс (только для подписчиков шины)
+    GAME_EVENT_TYPE_COUNT
+} GameEventType;
+
+const char* gameEventNames[GAME_EVENT_TYPE_COUNT] = {
+    "hit", "kill", "player_damaged", "bonus_collected", "boss_defeated", "level_complete", "boss_spawned"
+};
+
+// Кто нанёс удар
+typedef enum {
+    HIT_SOURCE_NONE,
+    HIT_SOURCE_BULLET,
+    HIT_SOURCE_KNIFE,
+    HIT_SOURCE_ENEMY,
+    HIT_SOURCE_BOSS_BULLET,
+    HIT_SOURCE_ENEMY_BULLET,
+    HIT_SOURCE_LASER
+} HitSource;
+
+typedef struct {
+    unsigned char type;       // GameEventType
+    unsigned char source;     // HitSource
+    unsigned char archetype;  // Архетип врага для HIT и KILL
+    EntityHandle target;      // Враг или бонус
+    EntityHandle sourceHandle; // Пуля, нож или враг
+    int amount;               // Урон или очки
+    float x, y;
+} GameEvent;
+
+// Худший тик. На врага: касание игрока, одна пуля (враг берёт первую свободную),
+// один луч лазера и одно убийство - дальше мёртвых пропускают. Ножу - одно
+// попадание, пуле по игроку и бонусу - по событию. Плюс победа над боссом,
+// конец уровня и появление босса. Очередь всегда вмещает тик целиком.
+#define GAME_EVENTS_PER_ENEMY 4
+#define MAX_GAME_EVENTS (MAX_ENEMIES * GAME_EVENTS_PER_ENEMY + MAX_KNIVES + MAX_BOSS_BULLETS + MAX_ENEMY_BULLETS + MAX_BONUSES + 3)
+
+typedef struct {
+    GameEvent events[MAX_GAME_EVENTS];
+    int count;
+} GameEventQueue;
+
+// ШИНА СОБЫТИЙ
+// Кольцо с одним писателем (симуляция) и любым числом читателей. Писатель
+// никогда не ждёт: медленный читатель, которого обогнали на целое кольцо,
+// теряет старые события и узнаёт об этом по счётчику пропусков.
+#define EVENT_BUS_SIZE 1024          // Степень двойки
+#define EVENT_BUS_WORDS 2
+#define EVENT_BUS_WRITING (~0ULL)    // Ячейка переписывается прямо сейчас
+#define EVENT_CONSUMER_IDLE 0.001    // Пауза читателя, когда событий нет (сек)
+#define MAX_EVENT_CONSUMERS 4
+
+// Сжатое событие для подписчиков
+typedef struct {
+    unsigned int tick;
+    unsigned char type;       // GameEventType
+    unsigned char source;     // HitSource
+    unsigned char archetype;
+    unsigned char level;
+    int amount;
+    short x, y;
+} BusEvent;
+
+static_assert(sizeof(BusEvent) == EVENT_BUS_WORDS * sizeof(unsigned long long), "bus event must fill its slot words");
+
+typedef struct {
+    std::atomic<unsigned long long> sequence;  // Номер события + 1, 0 - пусто
+    std::atomic<unsigned long long> words[EVENT_BUS_WORDS];
+} EventBusSlot;
+
+typedef struct {
+    EventBusSlot slots[EVENT_BUS_SIZE];
+    std::atomic<unsigned long long> published;  // Сколько событий записано
+} EventBus;
+
+// Позиция одного читателя; у каждого своя
+typedef struct {
+    EventBus* bus;
+    unsigned long long next;
+    unsigned long long received;
+    unsigned long long overruns;  // Событий потеряно из-за обгона
+} EventBusReader;
+
+typedef struct EventConsumer EventConsumer;
+typedef void (*EventHandler)(EventConsumer* consumer, const BusEvent* event);
+
+// Подписчик в своём потоке
+struct EventConsumer {
+    const char* name;
+    EventBusReader reader;
+    EventHandler handle;
+    void* data;
+    std::thread thread;
+    std::atomic<bool> quit;
+};
+
+// Счётчики телеметрии
+typedef struct {
+    long long counts[GAME_EVENT_TYPE_COUNT];
+    long long kills[ARCHETYPE_COUNT];
+    long long damageTaken;
+} EventStats;
+
+// ЗВУК
+// Симуляция после тика превращает события в команды и кладёт их в кольцо
+// с одним писателем и одним читателем - без блокировок и без ожидания.
+// Колбэк устройства забирает команды, запускает голоса и смешивает
+// заранее синтезированные PCM-буферы. Без устройства колбэк вызывает
+// пустое устройство - поток с тем же периодом, звук никуда не идёт.
+#define AUDIO_SAMPLE_RATE 48000
+#define AUDIO_BUFFER_FRAMES 512      // ~10.7 мс на вызов колбэка
+#define AUDIO_RING_SIZE 256          // Степень двойки
+#define AUDIO_MAX_VOICES 16
+#define AUDIO_BANK_SAMPLES 110000    // Все звуки, моно
+#define AUDIO_LATE_FACTOR 1.5        // Вызов позже полутора периодов - недобор
+#define AUDIO_MASTER_GAIN 0.5f
+
+typedef enum {
+    SOUND_HIT,
+    SOUND_KILL,
+    SOUND_PLAYER_HIT,
+    SOUND_BONUS,
+    SOUND_BOSS,
+    SOUND_LEVEL,
+    SOUND_COUNT
+} SoundId;
+
+typedef struct {
+    int offset;   // Начало в банке
+    int length;
+} AudioClip;
+
+// Как событие звучит: сколько раз за тик и как часто
+typedef struct {
+    int sound;         // SoundId, -1 - без звука
+    int perTick;
+    int cooldown;      // Тиков между срабатываниями
+    float gain;
+} AudioCue;
+
+typedef struct {
+    unsigned char sound;
+    float gain;
+    float pan;          // 0 - слева, 1 - справа
+    double time;        // Когда симуляция отправила команду, по AudioClock
+} AudioCommand;
+
+typedef struct {
+    AudioCommand commands[AUDIO_RING_SIZE];
+    std::atomic<unsigned int> head;  // Пишет только симуляция
+    std::atomic<unsigned int> tail;  // Пишет только колбэк
+} AudioCommandRing;
+
+typedef struct {
+    bool active;
+    int sound;
+    int position;
+    float left, right;  // Усиление каналов
+    unsigned int serial; // Порядок запуска: вытесняется самый старый
+} AudioVoice;
+
+typedef struct {
+    float pcm[AUDIO_BANK_SAMPLES];
+    AudioClip clips[SOUND_COUNT];
+    AudioCommandRing ring;
+
+    // Только поток звука
+    AudioVoice voices[AUDIO_MAX_VOICES];
+    unsigned int serial;
+    long long callbacks;
+    long long underruns;     // Колбэк опоздал больше чем на полпериода
+    long long voicesStarted;
+    long long voicesStolen;
+    double mixTime;
+    double lastCallback;
+    LatencyHistogram latency; // Команда -> старт голоса
+
+    // Только поток симуляции
+    int lastTick[GAME_EVENT_TYPE_COUNT];
+    long long commands;
+    long long throttled;     // Отсеяно лимитами событий
+    long long dropped;       // Кольцо было полно
+
+    bool nullDevice;
+    AudioStream stream;
+    std::thread nullThread;
+    std::atomic<bool> quit;
+} AudioMixer;
+
+// ДВОИЧНЫЙ ЖУРНАЛ
+// Вызов LOG не форматирует строку: место вызова регистрируется один раз,
+// а аргументы копируются как есть в кольцо своего потока. Фоновый поток
+// сбрасывает записи в файл, текст из него делает --decode-log.
+#define LOG_RING_SIZE 65536          // Байт на поток, степень двойки
+#define LOG_MAX_THREADS 16
+#define LOG_MAX_SITES 256
+#define LOG_MAX_ARGS 8
+#define LOG_MAX_STRING 48            // Длиннее строки обрезаются
+#define LOG_MAX_RECORD (LOG_MAX_ARGS * (LOG_MAX_STRING + 1))  // Байт аргументов одной записи
+#define LOG_FLUSH_INTERVAL 0.002     // Пауза фонового потока, сек
+#define LOG_MAGIC "HATLOG1"
+
+// Коды типов аргументов в сигнатуре места вызова
+#define LOG_ARG_INT 'i'
+#define LOG_ARG_UINT 'u'
+#define LOG_ARG_INT64 'l'
+#define LOG_ARG_DOUBLE 'd'
+#define LOG_ARG_STRING 's'
+
+typedef struct {
+    const char* format;
+    const char* file;
+    int line;
+    char signature[LOG_MAX_ARGS + 1];
+} LogSite;
+
+// Заголовок записи в кольце и в файле
+typedef struct {
+    unsigned short site;
+    unsigned short size;    // Байт аргументов после заголовка
+    unsigned int thread;
+    unsigned long long time; // Нс от запуска журнала
+} LogRecordHeader;
+
+// Кольцо одного потока: пишет поток, читает фоновый поток журнала
+typedef struct {
+    unsigned char data[LOG_RING_SIZE];
+    std::atomic<unsigned int> head;
+    std::atomic<unsigned int> tail;
+} LogRing;
+
+typedef struct {
+    LogSite sites[LOG_MAX_SITES];
+    std::atomic<int> siteCount;
+    std::mutex siteLock;
+    LogRing rings[LOG_MAX_THREADS];
+    std::atomic<int> ringCount;
+    std::atomic<bool> enabled;
+    std::atomic<bool> quit;
+    std::atomic<unsigned long long> dropped;
+    std::chrono::steady_clock::time_point start;
+    std::thread thread;
+    FILE* file;
+    bool siteWritten[LOG_MAX_SITES];  // Только фоновый поток
+    unsigned long long written;
+} Logger;
+
+static Logger logger;
+thread_local int logRingIndex = -1;
+
+// Тип аргумента -> код сигнатуры и запись сырых байт
+inline char LogArgType(int) { return LOG_ARG_INT; }
+inline char LogArgType(bool) { return LOG_ARG_INT; }
+inline char LogArgType(unsigned int) { return LOG_ARG_UINT; }
+inline char LogArgType(long long) { return LOG_ARG_INT64; }
+inline char LogArgType(unsigned long long) { return LOG_ARG_INT64; }
+inline char LogArgType(float) { return LOG_ARG_DOUBLE; }
+inline char LogArgType(double) { return LOG_ARG_DOUBLE; }
+inline char LogArgType(const char*) { return LOG_ARG_STRING; }
+
+inline int LogPackArg(unsigned char* out, int value) { memcpy(out, &value, sizeof(int)); return sizeof(int); }
+inline int LogPackArg(unsigned char* out, bool value) { return LogPackArg(out, (int)value); }
+inline int LogPackArg(unsigned char* out, unsigned int value) { memcpy(out, &value, sizeof(unsigned int)); return sizeof(unsigned int); }
+inline int LogPackArg(unsigned char* out, long long value) { memcpy(out, &value, sizeof(long long)); return sizeof(long long); }
+inline int LogPackArg(unsigned char* out, unsigned long long value) { return LogPackArg(out, (long long)value); }
+inline int LogPackArg(unsigned char* out, double value) { memcpy(out, &value, sizeof(double)); return sizeof(double); }
+inline int LogPackArg(unsigned char* out, float value) { return LogPackArg(out, (double)value); }
+inline int LogPackArg(unsigned char* out, const char* value) {
+    int length = value != NULL ? (int)strnlen(value, LOG_MAX_STRING) : 0;
+    out[0] = (unsigned char)length;
+    memcpy(out + 1, value, length);
+    return 1 + length;
+}
+
+inline int LogPack(unsigned char*) { return 0; }
+
+template<typename T, typename... Rest>
+int LogPack(unsigned char* out, T value, Rest... rest) {
+    int size = LogPackArg(out, value);
+    return size + LogPack(out + size, rest...);
+}
+
+// Сигнатура собирается один раз при регистрации места вызова
+inline void LogSignature(char* out) { *out = 0; }
+
+template<typename T, typename... Rest>
+void LogSignature(char* out, T value, Rest... rest) {
+    *out = LogArgType(value);
+    LogSignature(out + 1, rest...);
+}
+
+int AddLogSite(const char* format, const char* file, int line, const char* signature) {
+    std::lock_guard<std::mutex> lock(logger.siteLock);
+    int site = logger.siteCount.load(std::memory_order_relaxed);
+    if (site >= LOG_MAX_SITES) {
+        return -1;
+    }
+    logger.sites[site].format = format;
+    logger.sites[site].file = file;
+    logger.sites[site].line = line;
+    strncpy(logger.sites[site].signature, signature, LOG_MAX_ARGS);
+    logger.sites[site].signature[LOG_MAX_ARGS] = 0;
+    logger.siteCount.store(site + 1, std::memory_order_release);
+    return site;
+}
+
+template<typename... Args>
+int RegisterLogSite(const char* format, const char* file, int line, Args... args) {
+    static_assert(sizeof...(Args) <= LOG_MAX_ARGS, "too many log arguments");
+    char signature[LOG_MAX_ARGS + 1];
+    LogSignature(signature, args...);
+    return AddLogSite(format, file, line, signature);
+}
+
+// Запись в кольцо потока; при нехватке места запись теряется, поток не ждёт
+void LogWriteRecord(int site, const unsigned char* args, int size) {
+    if (logRingIndex < 0) {
+        logRingIndex = logger.ringCount.fetch_add(1);
+    }
+    if (site < 0 || logRingIndex >= LOG_MAX_THREADS) {
+        logger.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    LogRing* ring = &logger.rings[logRingIndex];
+
+    LogRecordHeader header;
+    header.site = (unsigned short)site;
+    header.size = (unsigned short)size;
+    header.thread = (unsigned int)logRingIndex;
+    header.time = (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - logger.start).count();
+
+    unsigned int head = ring->head.load(std::memory_order_relaxed);
+    unsigned int tail = ring->tail.load(std::memory_order_acquire);
+    unsigned int total = sizeof(header) + size;
+    if (LOG_RING_SIZE - (head - tail) < total) {
+        logger.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    unsigned char record[sizeof(LogRecordHeader) + LOG_MAX_RECORD];
+    memcpy(record, &header, sizeof(header));
+    memcpy(record + sizeof(header), args, size);
+    unsigned int offset = head & (LOG_RING_SIZE - 1);
+    unsigned int first = total < LOG_RING_SIZE - offset ? total : LOG_RING_SIZE - offset;
+    memcpy(ring->data + offset, record, first);
+    memcpy(ring->data, record + first, total - first);
+    ring->head.store(head + total, std::memory_order_release);
+}
+
+template<typename... Args>
+void LogWrite(int site, Args... args) {
+    unsigned char buffer[LOG_MAX_RECORD];
+    buffer[0] = 0;
+    int size = LogPack(buffer, args...);
+    LogWriteRecord(site, buffer, size);
+}
+
+// Место вызова регистрируется при первом проходе, дальше только копирование
+#define LOG(format, ...) do { \
+    if (logger.enabled.load(std::memory_order_relaxed)) { \
+        static const int logSite = RegisterLogSite(format, __FILE__, __LINE__, ##__VA_ARGS__); \
+        LogWrite(logSite, ##__VA_ARGS__); \
+    } \
+} while (0)
+
+void LogRingRead(LogRing* ring, unsigned int position, void* out, unsigned int size) {
+    unsigned int offset = position & (LOG_RING_SIZE - 1);
+    unsigned int first = size < LOG_RING_SIZE - offset ? size : LOG_RING_SIZE - offset;
+    memcpy(out, ring->data + offset, first);
+    memcpy((unsigned char*)out + first, ring->data, size - first);
+}
+
+// Формат файла: LOG_MAGIC, затем записи 'S' (описание места вызова,
+// пишется перед первой его записью) и 'R' (заголовок и сырые аргументы)
+void WriteLogString(FILE* file, const char* text) {
+    unsigned short length = (unsigned short)strlen(text);
+    fwrite(&length, sizeof(length), 1, file);
+    fwrite(text, 1, length, file);
+}
+
+void DrainLogRings() {
+    int ringCount = logger.ringCount.load(std::memory_order_acquire);
+    if (ringCount > LOG_MAX_THREADS) ringCount = LOG_MAX_THREADS;
+    for (int r = 0; r < ringCount; r++) {
+        LogRing* ring = &logger.rings[r];
+        unsigned int tail = ring->tail.load(std::memory_order_relaxed);
+        unsigned int head = ring->head.load(std::memory_order_acquire);
+        while (tail != head) {
+            LogRecordHeader header;
+            unsigned char args[LOG_MAX_RECORD];
+            LogRingRead(ring, tail, &header, sizeof(header));
+            LogRingRead(ring, tail + sizeof(header), args, header.size);
+            tail += sizeof(header) + header.size;
+
+            if (!logger.siteWritten[header.site]) {
+                LogSite* site = &logger.sites[header.site];
+                fputc('S', logger.file);
+                fwrite(&header.site, sizeof(header.site), 1, logger.file);
+                fwrite(&site->line, sizeof(site->line), 1, logger.file);
+                WriteLogString(logger.file, site->format);
+                WriteLogString(logger.file, site->file);
+                WriteLogString(logger.file, site->signature);
+                logger.siteWritten[header.site] = true;
+            }
+            fputc('R', logger.file);
+            fwrite(&header, sizeof(header), 1, logger.file);
+            fwrite(args, 1, header.size, logger.file);
+            logger.written++;
+        }
+        ring->tail.store(tail, std::memory_order_release);
+    }
+}
+
+void LoggerMain() {
+    for (;;) {
+        bool quit = logger.quit.load(std::memory_order_acquire);
+        DrainLogRings();
+        fflush(logger.file);
+        if (quit) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::duration<double>(LOG_FLUSH_INTERVAL));
+    }
+}
+
+bool StartLogger(const char* path) {
+    logger.file = fopen(path, "wb");
+    if (logger.file == NULL) {
+        return false;
+    }
+    fwrite(LOG_MAGIC, 1, sizeof(LOG_MAGIC), logger.file);
+    logger.start = std::chrono::steady_clock::now();
+    logger.written = 0;
+    logger.quit.store(false);
+    logger.thread = std::thread(LoggerMain);
+    logger.enabled.store(true, std::memory_order_release);
+    return true;
+}
+
+// Вызывать после остановки всех пишущих потоков, кроме текущего
+void StopLogger() {
+    if (logger.file == NULL) {
+        return;
+    }
+    logger.enabled.store(false, std::memory_order_relaxed);
+    logger.quit.store(true, std::memory_order_release);
+    logger.thread.join();
+    fclose(logger.file);
+    logger.file = NULL;
+}
+
+bool ReadLogString(FILE* file, char* out, int capacity) {
+    unsigned short length;
+    if (fread(&length, sizeof(length), 1, file) != 1 || length >= capacity) {
+        return false;
+    }
+    if (fread(out, 1, length, file) != length) {
+        return false;
+    }
+    out[length] = 0;
+    return true;
+}
+
+// Подставляет аргументы записи в формат места вызова. Модификаторы длины
+// из формата отбрасываются - тип берётся из сигнатуры.
+void FormatLogRecord(const char* format, const char* signature, const unsigned char* args, char* out, int capacity) {
+    int length = 0;
+    int arg = 0;
+    for (const char* p = format; *p != 0 && length < capacity - 1; p++) {
+        if (*p != '%' || p[1] == '%') {
+            out[length++] = *p;
+            if (*p == '%') p++;
+            continue;
+        }
+
+        char spec[32];
+        int specLength = 0;
+        spec[specLength++] = *p++;
+        while (*p != 0 && strchr("-+ #0123456789.", *p) != NULL && specLength < 20) {
+            spec[specLength++] = *p++;
+        }
+        while (*p != 0 && strchr("hlLzjt", *p) != NULL) {
+            p++;
+        }
+        char conversion = *p;
+        if (conversion == 0 || signature[arg] == 0) {
+            break;
+        }
+
+        char text[128];
+        switch (signature[arg++]) {
+        case LOG_ARG_INT: {
+            int value;
+            memcpy(&value, args, sizeof(value));
+            args += sizeof(value);
+            spec[specLength++] = conversion;
+            spec[specLength] = 0;
+            snprintf(text, sizeof(text), spec, value);
+            break;
+        }
+        case LOG_ARG_UINT: {
+            unsigned int value;
+            memcpy(&value, args, sizeof(value));
+            args += sizeof(value);
+            spec[specLength++] = conversion;
+            spec[specLength] = 0;
+            snprintf(text, sizeof(text), spec, value);
+            break;
+        }
+        case LOG_ARG_INT64: {
+            long long value;
+            memcpy(&value, args, sizeof(value));
+            args += sizeof(value);
+            spec[specLength++] = 'l';
+            spec[specLength++] = 'l';
+            spec[specLength++] = conversion;
+            spec[specLength] = 0;
+            snprintf(text, sizeof(text), spec, value);
+            break;
+        }
+        case LOG_ARG_DOUBLE: {
+            double value;
+            memcpy(&value, args, sizeof(value));
+            args += sizeof(value);
+            spec[specLength++] = conversion;
+            spec[specLength] = 0;
+            snprintf(text, sizeof(text), spec, value);
+            break;
+        }
+        default: {
+            int size = args[0];
+            char value[LOG_MAX_STRING + 1];
+            memcpy(value, args + 1, size);
+            value[size] = 0;
+            args += 1 + size;
+            spec[specLength++] = 's';
+            spec[specLength] = 0;
+            snprintf(text, sizeof(text), spec, value);
+            break;
+        }
+        }
+        for (const char* t = text; *t != 0 && length < capacity - 1; t++) {
+            out[length++] = *t;
+        }
+    }
+    out[length] = 0;
+}
+
+// --decode-log: двоичный журнал -> текст
+bool DecodeLogFile(const char* inputPath, FILE* output) {
+    FILE* input = fopen(inputPath, "rb");
+    if (input == NULL) {
+        return false;
+    }
+    char magic[sizeof(LOG_MAGIC)];
+    if (fread(magic, 1, sizeof(magic), input) != sizeof(magic) || memcmp(magic, LOG_MAGIC, sizeof(magic)) != 0) {
+        fclose(input);
+        return false;
+    }
+
+    static char formats[LOG_MAX_SITES][256];
+    static char files[LOG_MAX_SITES][256];
+    static char signatures[LOG_MAX_SITES][LOG_MAX_ARGS + 1];
+    static int lines[LOG_MAX_SITES];
+    bool ok = true;
+    int tag;
+    while ((tag = fgetc(input)) != EOF) {
+        if (tag == 'S') {
+            unsigned short site;
+            int line;
+            if (fread(&site, sizeof(site), 1, input) != 1 || site >= LOG_MAX_SITES ||
+                fread(&line, sizeof(line), 1, input) != 1 ||
+                !ReadLogString(input, formats[site], sizeof(formats[site])) ||
+                !ReadLogString(input, files[site], sizeof(files[site])) ||
+                !ReadLogString(input, signatures[site], sizeof(signatures[site]))) {
+                ok = false;
+                break;
+            }
+            lines[site] = line;
+        }
+        else if (tag == 'R') {
+            LogRecordHeader header;
+            unsigned char args[LOG_MAX_RECORD];
+            if (fread(&header, sizeof(header), 1, input) != 1 || header.site >= LOG_MAX_SITES ||
+                header.size > LOG_MAX_RECORD || fread(args, 1, header.size, input) != header.size) {
+                ok = false;
+                break;
+            }
+            char text[512];
+            FormatLogRecord(formats[header.site], signatures[header.site], args, text, sizeof(text));
+            fprintf(output, "%12.6f [%u] %s:%d: %s\n", header.time / 1e9, header.thread,
+                files[header.site], lines[header.site], text);
+        }
+        else {
+            ok = false;
+            break;
+        }
+    }
+    fclose(input);
+    return ok;
+}
+
 // Структура игры
 typedef struct {
     char state[20];
@@ -123,6 +1412,7 @@ typedef struct {
     int enemiesToDefeat;
     int enemiesDefeated;
     Player player;
+    Rectangle view;              // Видимая часть арены на начало тика
     Bullet bullets[MAX_BULLETS];
     int bulletCount;
     BossBullet bossBullets[MAX_BOSS_BULLETS];
@@ -135,956 +1425,4698 @@ typedef struct {
     int bonusCount;
     Knife knives[MAX_KNIVES];
     int knifeCount;
-    int enemySpawnTimer;
+    SlotMap bulletSlots;
+    SlotMap bossBulletSlots;
+    SlotMap enemyBulletSlots;
+    SlotMap enemySlots;
+    SlotMap bonusSlots;
+    SlotMap knifeSlots;
+    TimerHandle enemySpawnTimer;
     int levelCompleteTimer;
-    int bonusSpawnTimer;
+    TimerHandle bonusSpawnTimer;
+    TimerHandle invincibleTimer;   // Неуязвимость игрока
+    TimerHandle damageBonusTimer;  // Бонус урона игрока
+    TimerHandle laserTimer;
+    LaserBeam laser;
     bool bossSpawned;
     bool bossDefeated;
+    bool benchMode;
+    int crowdSize;             // Дополнительная толпа на уровень (--crowd)
+    RaycastBench raycastBench;
+    QueryBench queryBench;
+    ParticleBench particleBench;
+    FlowBench flowBench;
+    QualityGovernor quality;
+    int tick;
+
+    JobSystem* jobs;
+    CollisionBuffers* collision;
+    SeparationGrid* separation;
+    EnemyIndex* enemyIndex;
+    AiScheduler* ai;
+    TimerWheel* timers;
+    PatternLibrary* patterns;
+    FlowField* flow;
+    ParticleSystem* particles;
+    Presenter* present;
+    GameEventQueue events;
+    EventBus* bus;
+    EventConsumer* consumers[MAX_EVENT_CONSUMERS];
+    int consumerCount;
+    EventStats* eventStats;
+    AudioMixer* audio;
+    Profiler profiler;
+    LatencyTracker latency;
 
     Button newGameButton;
     Button continueButton;
     Button quitButton;
 } Game;
 
-// Функции для кнопок
-Button CreateButton(float x, float y, float width, float height, const char* text, Color color, Color hoverColor) {
-    Button button;
-    button.rect = { x - width / 2, y - height / 2, width, height };
-    button.text = text;
-    button.color = color;
-    button.hoverColor = hoverColor;
-    button.currentColor = color;
-    return button;
+// Функции слот-карты
+void InitSlotMap(SlotMap* map) {
+    for (int i = 0; i < SLOT_MAP_CAPACITY; i++) {
+        map->generation[i] = 1;
+    }
+    map->count = 0;
+    map->freeCount = 0;
+    // Свободные слоты выдаются с нулевого
+    for (int i = SLOT_MAP_CAPACITY - 1; i >= 0; i--) {
+        map->freeSlots[map->freeCount++] = (unsigned short)i;
+    }
 }
 
-void DrawButton(Button button) {
-    DrawRectangleRec(button.rect, button.currentColor);
-    DrawRectangleLinesEx(button.rect, 2, WHITE);
+void BumpSlotGeneration(SlotMap* map, int slot) {
+    map->generation[slot]++;
+    if (map->generation[slot] == 0) map->generation[slot] = 1;
+}
 
-    int fontSize = 20;
-    Vector2 textSize = MeasureTextEx(GetFontDefault(), button.text, fontSize, 1);
-    Vector2 textPos = {
-        button.rect.x + button.rect.width / 2 - textSize.x / 2,
-        button.rect.y + button.rect.height / 2 - textSize.y / 2
-    };
+// Все сущности удалены разом - их хэндлы больше не находятся
+void ClearSlotMap(SlotMap* map) {
+    for (int i = 0; i < map->count; i++) {
+        BumpSlotGeneration(map, map->slotOf[i]);
+    }
+    map->count = 0;
+    map->freeCount = 0;
+    for (int i = SLOT_MAP_CAPACITY - 1; i >= 0; i--) {
+        map->freeSlots[map->freeCount++] = (unsigned short)i;
+    }
+}
 
-    DrawText(button.text, textPos.x, textPos.y, fontSize, WHITE);
+// Выдаёт слоты элементам, дописанным в конец массива
+void SlotMapAdopt(SlotMap* map, int count) {
+    for (int i = map->count; i < count; i++) {
+        int slot = map->freeSlots[--map->freeCount];
+        map->slotOf[i] = (unsigned short)slot;
+        map->denseOf[slot] = (unsigned short)i;
+    }
+    map->count = count;
 }
 
-bool IsButtonHovered(Button button) {
-    return CheckCollisionPointRec(GetMousePosition(), button.rect);
+EntityHandle SlotMapHandle(const SlotMap* map, int index) {
+    EntityHandle handle;
+    handle.slot = map->slotOf[index];
+    handle.generation = map->generation[handle.slot];
+    return handle;
 }
 
-void UpdateButton(Button* button) {
-    if (IsButtonHovered(*button)) {
-        button->currentColor = button->hoverColor;
+// Индекс в массиве или -1, если сущность уже удалена
+int SlotMapFind(const SlotMap* map, EntityHandle handle) {
+    if (handle.generation == 0 || handle.slot >= SLOT_MAP_CAPACITY ||
+        map->generation[handle.slot] != handle.generation) {
+        return -1;
     }
-    else {
-        button->currentColor = button->color;
+    return map->denseOf[handle.slot];
+}
+
+// Удаление за O(1): последний элемент переезжает на место удалённого
+void SlotMapErase(SlotMap* map, void* items, size_t itemSize, int* count, int index) {
+    int last = *count - 1;
+    int slot = map->slotOf[index];
+    BumpSlotGeneration(map, slot);
+    map->freeSlots[map->freeCount++] = (unsigned short)slot;
+
+    if (index != last) {
+        memcpy((char*)items + index * itemSize, (char*)items + last * itemSize, itemSize);
+        map->slotOf[index] = map->slotOf[last];
+        map->denseOf[map->slotOf[index]] = (unsigned short)index;
     }
+    *count = last;
+    map->count = last;
 }
 
-// Функции для ножей
-Knife CreateKnife(float startX, float startY, float angle) {
-    Knife knife;
-    knife.x = startX;
-    knife.y = startY;
-    knife.speed = 8;
-    knife.radius = 5;
-    knife.color = RED;
-    knife.directionAngle = angle;
-    knife.distanceTraveled = 0;
-    knife.maxDistance = 200;
-    return knife;
+// Функции колеса таймеров
+void LinkTimer(TimerWheel* wheel, int index, int bucket) {
+    Timer* timer = &wheel->timers[index];
+    timer->bucket = bucket;
+    timer->next = -1;
+    timer->prev = wheel->tail[bucket];
+    if (timer->prev >= 0) wheel->timers[timer->prev].next = index;
+    else wheel->head[bucket] = index;
+    wheel->tail[bucket] = index;
 }
 
-void UpdateKnife(Knife* knife) {
-    knife->x += cos(knife->directionAngle) * knife->speed;
-    knife->y += sin(knife->directionAngle) * knife->speed;
-    knife->distanceTraveled += knife->speed;
+void UnlinkTimer(TimerWheel* wheel, int index) {
+    Timer* timer = &wheel->timers[index];
+    if (timer->prev >= 0) wheel->timers[timer->prev].next = timer->next;
+    else wheel->head[timer->bucket] = timer->next;
+    if (timer->next >= 0) wheel->timers[timer->next].prev = timer->prev;
+    else wheel->tail[timer->bucket] = timer->prev;
 }
 
-void DrawKnife(Knife knife) {
-    Vector2 points[3] = {
-        {knife.x + 10, knife.y},
-        {knife.x - 3, knife.y + 3},
-        {knife.x - 3, knife.y - 3}
-    };
-
-    for (int i = 0; i < 3; i++) {
-        Vector2 rotated = {
-            knife.x + (points[i].x - knife.x) * cos(knife.directionAngle) - (points[i].y - knife.y) * sin(knife.directionAngle),
-            knife.y + (points[i].x - knife.x) * sin(knife.directionAngle) + (points[i].y - knife.y) * cos(knife.directionAngle)
-        };
-        points[i] = rotated;
-    }
-
-    DrawTriangle(points[0], points[1], points[2], RED);
-    DrawTriangleLines(points[0], points[1], points[2], BLACK);
+void FreeTimer(TimerWheel* wheel, int index) {
+    Timer* timer = &wheel->timers[index];
+    timer->bucket = -1;
+    timer->generation++;
+    if (timer->generation == 0) timer->generation = 1;
+    timer->next = wheel->freeHead;
+    wheel->freeHead = index;
+    wheel->active--;
 }
 
-bool IsKnifeOffScreen(Knife knife) {
-    return (knife.x < -20 || knife.x > WIDTH + 20 ||
-        knife.y < -20 || knife.y > HEIGHT + 20 ||
-        knife.distanceTraveled >= knife.maxDistance);
+// Уровень выбирается по тому, как далеко срок; корзина - по битам срока
+int TimerBucket(TimerWheel* wheel, unsigned int expires) {
+    unsigned int delta = expires - wheel->now;
+    int level = 0;
+    while (level < TIMER_WHEEL_LEVELS - 1 && delta >= (1u << (TIMER_WHEEL_BITS * (level + 1)))) {
+        level++;
+    }
+    return level * TIMER_WHEEL_SLOTS + ((expires >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1));
 }
 
-// Функции для бонусов
-HatBonus CreateHatBonus(float startX, float startY, const char* type) {
-    HatBonus bonus;
-    bonus.x = startX;
-    bonus.y = startY;
-    bonus.width = 30;
-    bonus.height = 25;
-    bonus.speed = 2;
-    bonus.collected = false;
-    bonus.lifetime = 300;
-    strcpy(bonus.bonusType, type);
-
-    if (strcmp(type, "damage") == 0) {
-        bonus.color = GOLD;
+void InitTimerWheel(TimerWheel* wheel) {
+    for (int b = 0; b < TIMER_BUCKETS; b++) {
+        wheel->head[b] = -1;
+        wheel->tail[b] = -1;
     }
-    else {
-        bonus.color = RED;
+    // Свободные таймеры выдаются с нулевого
+    wheel->freeHead = -1;
+    for (int i = TIMER_MAX - 1; i >= 0; i--) {
+        wheel->timers[i].bucket = -1;
+        wheel->timers[i].generation = 1;
+        wheel->timers[i].next = wheel->freeHead;
+        wheel->freeHead = i;
     }
-    return bonus;
+    wheel->now = 0;
+    wheel->active = 0;
+    wheel->scheduled = 0;
+    wheel->fired = 0;
+    wheel->cascaded = 0;
 }
 
-void UpdateHatBonus(HatBonus* bonus) {
-    bonus->y += bonus->speed;
-    bonus->lifetime--;
+// Снимает все таймеры, время колеса не трогает
+void ClearTimerWheel(TimerWheel* wheel) {
+    for (int b = 0; b < TIMER_BUCKETS; b++) {
+        int index = wheel->head[b];
+        while (index >= 0) {
+            int next = wheel->timers[index].next;
+            FreeTimer(wheel, index);
+            index = next;
+        }
+        wheel->head[b] = -1;
+        wheel->tail[b] = -1;
+    }
 }
 
-void DrawHatBonus(HatBonus bonus) {
-    DrawRectangle(bonus.x - bonus.width / 2, bonus.y, bonus.width, 10, bonus.color);
-    DrawRectangle(bonus.x - bonus.width / 3, bonus.y - 15, bonus.width / 1.5f, 15, bonus.color);
-
-    const char* bonusName = (strcmp(bonus.bonusType, "damage") == 0) ? "DMG x2" : "KNIVES";
-    Color textColor = (strcmp(bonus.bonusType, "damage") == 0) ? BLACK : WHITE;
-    int textWidth = MeasureText(bonusName, 12);
-    DrawText(bonusName, bonus.x - textWidth / 2, bonus.y - 30, 12, textColor);
+// Срок не раньше следующего тика и не дальше TIMER_MAX_DELAY
+TimerHandle ScheduleTimer(TimerWheel* wheel, TimerType type, unsigned int expires, EntityHandle target) {
+    TimerHandle handle = { 0, 0 };
+    if (wheel->freeHead < 0) {
+        LOG("timer wheel full, timer type %d dropped", (int)type);
+        return handle;
+    }
+    if ((int)(expires - wheel->now) <= 0) expires = wheel->now + 1;
+    if (expires - wheel->now > TIMER_MAX_DELAY) expires = wheel->now + TIMER_MAX_DELAY;
+
+    int index = wheel->freeHead;
+    Timer* timer = &wheel->timers[index];
+    wheel->freeHead = timer->next;
+    timer->expires = expires;
+    timer->type = (unsigned char)type;
+    timer->target = target;
+    LinkTimer(wheel, index, TimerBucket(wheel, expires));
+    wheel->active++;
+    wheel->scheduled++;
+
+    handle.index = (unsigned short)index;
+    handle.generation = timer->generation;
+    return handle;
 }
 
-bool ShouldRemoveBonus(HatBonus bonus) {
-    return bonus.lifetime <= 0 || bonus.y > HEIGHT;
+bool TimerPending(const TimerWheel* wheel, TimerHandle handle) {
+    const Timer* timer = &wheel->timers[handle.index];
+    return handle.generation != 0 && timer->generation == handle.generation && timer->bucket >= 0;
 }
 
-bool BonusCollidesWithPlayer(HatBonus bonus, Player player) {
-    float distance = sqrt(pow(bonus.x - player.x, 2) + pow(bonus.y - player.y, 2));
-    return distance < (bonus.width / 2 + player.radius);
+bool CancelTimer(TimerWheel* wheel, TimerHandle handle) {
+    if (!TimerPending(wheel, handle)) {
+        return false;
+    }
+    UnlinkTimer(wheel, handle.index);
+    FreeTimer(wheel, handle.index);
+    return true;
 }
 
-// Функции для игрока
-Player CreatePlayer() {
-    Player player;
-    player.x = WIDTH / 2;
-    player.y = HEIGHT - 50;
-    player.radius = 20;
-    player.speed = 5;
-    player.color = BLUE;
-    player.health = 10;
-    player.lives = 1;
-    player.invincible = false;
-    player.invincibleTimer = 0;
-    player.damageMultiplier = 1;
-    player.bonusTimer = 0;
-    player.hasKnifeBonus = false;
-    player.shootCooldown = 0;
-    return player;
+// Переносит таймер на новый срок или заводит, если его нет
+void RescheduleTimer(TimerWheel* wheel, TimerHandle* handle, TimerType type, unsigned int expires, EntityHandle target) {
+    CancelTimer(wheel, *handle);
+    *handle = ScheduleTimer(wheel, type, expires, target);
 }
 
-void DrawPlayer(Player player) {
-    DrawLine(player.x - 8, player.y + player.radius, player.x - 12, player.y + player.radius + 15, BLACK);
-    DrawLine(player.x + 8, player.y + player.radius, player.x + 12, player.y + player.radius + 15, BLACK);
-
-    DrawLine(player.x - 12, player.y, player.x - 12 - 18, player.y + 5, BLACK);
-    DrawLine(player.x + 12, player.y, player.x + 12 + 18, player.y + 5, BLACK);
-
-    Color bodyColor = player.invincible ? RED : player.color;
-    DrawCircle(player.x, player.y, player.radius, bodyColor);
+// Сдвигает колесо на тик. Сработавшие таймеры забираются через PopExpiredTimer.
+void AdvanceTimerWheel(TimerWheel* wheel) {
+    wheel->now++;
 
-    Color hatColor;
-    if (player.hasKnifeBonus) {
-        hatColor = RED;
-    }
-    else if (player.damageMultiplier > 1) {
-        hatColor = GOLD;
-    }
-    else {
-        hatColor = DARKBLUE;
+    // На границе уровня его корзина раскладывается по нижним уровням
+    for (int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+        if ((wheel->now & ((1u << (TIMER_WHEEL_BITS * level)) - 1)) != 0) {
+            break;
+        }
+        int bucket = level * TIMER_WHEEL_SLOTS + ((wheel->now >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1));
+        int index = wheel->head[bucket];
+        wheel->head[bucket] = -1;
+        wheel->tail[bucket] = -1;
+        while (index >= 0) {
+            int next = wheel->timers[index].next;
+            LinkTimer(wheel, index, TimerBucket(wheel, wheel->timers[index].expires));
+            wheel->cascaded++;
+            index = next;
+        }
     }
 
-    DrawRectangle(player.x - 25, player.y - player.radius - 20, 50, 15, hatColor);
-    DrawRectangle(player.x - 15, player.y - player.radius - 35, 30, 20, hatColor);
-
-    DrawCircle(player.x - 8, player.y - 5, 5, WHITE);
-    DrawCircle(player.x + 8, player.y - 5, 5, WHITE);
-
-    Vector2 mousePos = GetMousePosition();
-    float dx = mousePos.x - player.x;
-    float dy = mousePos.y - player.y;
-    float distance = sqrt(dx * dx + dy * dy);
-    if (distance > 0) {
-        dx /= distance;
-        dy /= distance;
+    // Всё в корзине текущего тика истекает именно сейчас
+    int bucket = wheel->now & (TIMER_WHEEL_SLOTS - 1);
+    int index = wheel->head[bucket];
+    wheel->head[bucket] = -1;
+    wheel->tail[bucket] = -1;
+    while (index >= 0) {
+        int next = wheel->timers[index].next;
+        LinkTimer(wheel, index, TIMER_FIRED_BUCKET);
+        index = next;
     }
+}
 
-    DrawCircle(player.x - 8 + dx * 2, player.y - 5 + dy * 2, 2, BLACK);
-    DrawCircle(player.x + 8 + dx * 2, player.y - 5 + dy * 2, 2, BLACK);
-
-    if (player.health <= 3) {
-        Vector2 mouthPoints[3] = {
-            {player.x - 8, player.y + 3},
-            {player.x + 8, player.y + 3},
-            {player.x, player.y + 13}
-        };
-        DrawTriangle(mouthPoints[0], mouthPoints[1], mouthPoints[2], BLACK);
-    }
-    else if (player.invincible) {
-        Vector2 mouthPoints[3] = {
-            {player.x - 8, player.y + 13},
-            {player.x + 8, player.y + 13},
-            {player.x, player.y + 3}
-        };
-        DrawTriangle(mouthPoints[0], mouthPoints[1], mouthPoints[2], RED);
-    }
-    else {
-        DrawLine(player.x - 6, player.y + 5, player.x + 6, player.y + 5, BLACK);
+bool PopExpiredTimer(TimerWheel* wheel, Timer* out) {
+    int index = wheel->head[TIMER_FIRED_BUCKET];
+    if (index < 0) {
+        return false;
     }
-
-    DrawRectangle(player.x - 20, player.y - player.radius - 10, 40, 6, RED);
-    DrawRectangle(player.x - 20, player.y - player.radius - 10, 40 * (player.health / 10.0f), 6, GREEN);
+    *out = wheel->timers[index];
+    UnlinkTimer(wheel, index);
+    FreeTimer(wheel, index);
+    wheel->fired++;
+    return true;
 }
 
-void MovePlayer(Player* player) {
-    if (IsKeyDown(KEY_LEFT) && player->x - player->radius > 0) {
-        player->x -= player->speed;
-    }
-    if (IsKeyDown(KEY_RIGHT) && player->x + player->radius < WIDTH) {
-        player->x += player->speed;
+// Функции шины событий
+void InitEventBus(EventBus* bus) {
+    for (int i = 0; i < EVENT_BUS_SIZE; i++) {
+        bus->slots[i].sequence.store(0, std::memory_order_relaxed);
     }
-    if (IsKeyDown(KEY_UP) && player->y - player->radius > 0) {
-        player->y -= player->speed;
-    }
-    if (IsKeyDown(KEY_DOWN) && player->y + player->radius < HEIGHT) {
-        player->y += player->speed;
+    bus->published.store(0, std::memory_order_release);
+}
+
+// Только из потока симуляции. Ячейка пишется как seqlock: читатель,
+// заставший запись, увидит несовпадение номера и перечитает.
+void PublishBusEvent(EventBus* bus, const BusEvent* event) {
+    unsigned long long sequence = bus->published.load(std::memory_order_relaxed);
+    EventBusSlot* slot = &bus->slots[sequence & (EVENT_BUS_SIZE - 1)];
+    unsigned long long words[EVENT_BUS_WORDS];
+    memcpy(words, event, sizeof(BusEvent));
+
+    slot->sequence.store(EVENT_BUS_WRITING, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (int w = 0; w < EVENT_BUS_WORDS; w++) {
+        slot->words[w].store(words[w], std::memory_order_relaxed);
     }
+    slot->sequence.store(sequence + 1, std::memory_order_release);
+    bus->published.store(sequence + 1, std::memory_order_release);
 }
 
-bool PlayerTakeDamage(Player* player, int damage) {
-    if (!player->invincible) {
-        player->health -= damage;
-        player->invincible = true;
-        player->invincibleTimer = 90;
+void InitEventBusReader(EventBusReader* reader, EventBus* bus) {
+    reader->bus = bus;
+    reader->next = bus->published.load(std::memory_order_acquire);
+    reader->received = 0;
+    reader->overruns = 0;
+}
 
-        if (player->health <= 0) {
-            player->lives--;
-            player->health = 0;
-            player->damageMultiplier = 1;
-            player->bonusTimer = 0;
-            player->hasKnifeBonus = false;
-            return true;
+// false - новых событий нет
+bool ReadBusEvent(EventBusReader* reader, BusEvent* event) {
+    EventBus* bus = reader->bus;
+    for (;;) {
+        unsigned long long published = bus->published.load(std::memory_order_acquire);
+        if (reader->next >= published) {
+            return false;
+        }
+        // Писатель ушёл на целое кольцо вперёд - старые события уже затёрты
+        if (published - reader->next > EVENT_BUS_SIZE) {
+            unsigned long long oldest = published - EVENT_BUS_SIZE;
+            reader->overruns += oldest - reader->next;
+            reader->next = oldest;
         }
-    }
-    return false;
-}
 
-void UpdatePlayer(Player* player) {
-    if (player->invincible) {
-        player->invincibleTimer--;
-        if (player->invincibleTimer <= 0) {
-            player->invincible = false;
+        EventBusSlot* slot = &bus->slots[reader->next & (EVENT_BUS_SIZE - 1)];
+        unsigned long long before = slot->sequence.load(std::memory_order_acquire);
+        unsigned long long words[EVENT_BUS_WORDS];
+        for (int w = 0; w < EVENT_BUS_WORDS; w++) {
+            words[w] = slot->words[w].load(std::memory_order_relaxed);
         }
-    }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        unsigned long long after = slot->sequence.load(std::memory_order_relaxed);
 
-    if (player->damageMultiplier > 1) {
-        player->bonusTimer--;
-        if (player->bonusTimer <= 0) {
-            player->damageMultiplier = 1;
+        if (before == reader->next + 1 && after == before) {
+            memcpy(event, words, sizeof(BusEvent));
+            reader->next++;
+            reader->received++;
+            return true;
         }
+        // Ячейку переписали во время чтения - на следующем круге это станет обгоном
     }
+}
 
-    if (player->shootCooldown > 0) {
-        player->shootCooldown--;
+void EventConsumerMain(EventConsumer* consumer) {
+    BusEvent event;
+    for (;;) {
+        // Флаг читается до разбора: после остановки писателя хвост дочитывается целиком
+        bool quit = consumer->quit.load(std::memory_order_acquire);
+        while (ReadBusEvent(&consumer->reader, &event)) {
+            consumer->handle(consumer, &event);
+        }
+        if (quit) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::duration<double>(EVENT_CONSUMER_IDLE));
     }
 }
 
-void AddDamageBonus(Player* player) {
-    player->damageMultiplier = 2;
-    player->bonusTimer = 600;
-    player->hasKnifeBonus = false;
+void StartEventConsumer(EventConsumer* consumer, EventBus* bus, const char* name, EventHandler handle, void* data) {
+    consumer->name = name;
+    consumer->handle = handle;
+    consumer->data = data;
+    consumer->quit.store(false);
+    InitEventBusReader(&consumer->reader, bus);
+    consumer->thread = std::thread(EventConsumerMain, consumer);
 }
 
-void AddKnifeBonus(Player* player) {
-    player->hasKnifeBonus = true;
-    player->damageMultiplier = 1;
-    player->bonusTimer = 0;
+void StopEventConsumer(EventConsumer* consumer) {
+    consumer->quit.store(true, std::memory_order_release);
+    if (consumer->thread.joinable()) {
+        consumer->thread.join();
+    }
 }
 
-bool IsPlayerAlive(Player player) {
-    return player.lives > 0 && player.health > 0;
+// Заметные события в двоичный журнал
+void LogEventHandler(EventConsumer*, const BusEvent* event) {
+    switch (event->type) {
+    case GAME_EVENT_BOSS_SPAWNED:
+        LOG("BOSS SPAWNED! (tick %u)", event->tick);
+        break;
+    case GAME_EVENT_BOSS_DEFEATED:
+        LOG("BOSS DEFEATED! (tick %u)", event->tick);
+        break;
+    case GAME_EVENT_LEVEL_COMPLETE:
+        LOG("LEVEL %d COMPLETE (tick %u)", (int)event->level, event->tick);
+        break;
+    default:
+        break;
+    }
 }
 
-void CreatePlayerKnives(Player player, Knife knives[], int* knifeCount) {
-    for (int i = 0; i < 10; i++) {
-        if (*knifeCount < MAX_KNIVES) {
-            float angle = i * 36 * PI / 180.0f;
-            knives[*knifeCount] = CreateKnife(player.x, player.y, angle);
-            (*knifeCount)++;
-        }
+// Телеметрия: счётчики по типам событий
+void StatsEventHandler(EventConsumer* consumer, const BusEvent* event) {
+    EventStats* stats = (EventStats*)consumer->data;
+    stats->counts[event->type]++;
+    if (event->type == GAME_EVENT_KILL) {
+        stats->kills[event->archetype]++;
+    }
+    else if (event->type == GAME_EVENT_PLAYER_DAMAGED) {
+        stats->damageTaken += event->amount;
     }
 }
 
-// Функции для пуль
-Bullet CreateBullet(float startX, float startY, float targetX, float targetY, int level, int damageMultiplier) {
-    Bullet bullet;
-    bullet.x = startX;
-    bullet.y = startY;
-    bullet.radius = 8;
-    bullet.speed = 7 + level;
-
-    if (level == 1) bullet.color = GREEN;
-    else if (level == 2) bullet.color = YELLOW;
-    else bullet.color = PURPLE;
-
-    bullet.damage = 3 * damageMultiplier;
+GameEvent* PushGameEvent(Game* game, GameEventType type, HitSource source, EntityHandle target, EntityHandle sourceHandle, int amount, float x, float y) {
+    // Ёмкость рассчитана на худший тик (MAX_GAME_EVENTS), поэтому место есть
+    // всегда и вызывающие пишут в событие без проверки
+    GameEventQueue* queue = &game->events;
+    assert(queue->count < MAX_GAME_EVENTS);
+    GameEvent* event = &queue->events[queue->count++];
+    event->type = (unsigned char)type;
+    event->source = (unsigned char)source;
+    event->archetype = 0;
+    event->target = target;
+    event->sourceHandle = sourceHandle;
+    event->amount = amount;
+    event->x = x;
+    event->y = y;
+    return event;
+}
 
-    float diffX = targetX - startX;
-    float diffY = targetY - startY;
-    float distance = sqrt(diffX * diffX + diffY * diffY);
-    if (distance > 0) {
-        bullet.dx = diffX / distance * bullet.speed;
-        bullet.dy = diffY / distance * bullet.speed;
+// Отдаёт события тика подписчикам шины
+void PublishGameEvents(Game* game) {
+    if (game->bus == NULL) {
+        return;
     }
-    else {
-        bullet.dx = 0;
-        bullet.dy = -bullet.speed;
+    for (int e = 0; e < game->events.count; e++) {
+        GameEvent* source = &game->events.events[e];
+        BusEvent event;
+        event.tick = (unsigned int)game->tick;
+        event.type = source->type;
+        event.source = source->source;
+        event.archetype = source->archetype;
+        event.level = (unsigned char)game->level;
+        event.amount = source->amount;
+        event.x = (short)source->x;
+        event.y = (short)source->y;
+        PublishBusEvent(game->bus, &event);
     }
+}
 
-    return bullet;
+// Вид на арену: окно с центром на точке, прижатое к краям арены
+Rectangle WorldView(float x, float y) {
+    float left = x - WIDTH / 2;
+    float top = y - HEIGHT / 2;
+    left = left < 0 ? 0 : (left > WORLD_WIDTH - WIDTH ? WORLD_WIDTH - WIDTH : left);
+    top = top < 0 ? 0 : (top > WORLD_HEIGHT - HEIGHT ? WORLD_HEIGHT - HEIGHT : top);
+    return Rectangle{ left, top, (float)WIDTH, (float)HEIGHT };
 }
 
-void UpdateBullet(Bullet* bullet) {
-    bullet->x += bullet->dx;
-    bullet->y += bullet->dy;
+// Точка с запасом margin задевает вид
+bool IsInView(Rectangle view, float x, float y, float margin) {
+    return x >= view.x - margin && x <= view.x + view.width + margin &&
+        y >= view.y - margin && y <= view.y + view.height + margin;
 }
 
-void DrawBullet(Bullet bullet) {
-    DrawCircle(bullet.x, bullet.y, bullet.radius, bullet.color);
-    DrawCircleLines(bullet.x, bullet.y, bullet.radius, BLACK);
+// Мышь в логических координатах вида -> арена
+Vector2 ViewToWorld(Rectangle view, Vector2 point) {
+    return Vector2{ point.x + view.x, point.y + view.y };
 }
 
-bool IsBulletOffScreen(Bullet bullet) {
-    return (bullet.x < -bullet.radius || bullet.x > WIDTH + bullet.radius ||
-        bullet.y < -bullet.radius || bullet.y > HEIGHT + bullet.radius);
+// Функции для кнопок
+Button CreateButton(float x, float y, float width, float height, const char* text, Color color, Color hoverColor) {
+    Button button;
+    button.rect = { x - width / 2, y - height / 2, width, height };
+    button.text = text;
+    button.color = color;
+    button.hoverColor = hoverColor;
+    button.currentColor = color;
+    return button;
 }
 
-// Функции для пуль босса
-BossBullet CreateBossBullet(float startX, float startY, float dx, float dy) {
-    BossBullet bullet;
-    bullet.x = startX;
-    bullet.y = startY;
-    bullet.radius = 8;
-    bullet.speed = 5;
-    bullet.color = { 255, 50, 50, 255 };
-    bullet.damage = 2;
+void DrawButton(Button button) {
+    DrawRectangleRec(button.rect, button.currentColor);
+    DrawRectangleLinesEx(button.rect, 2, WHITE);
 
-    bullet.dx = dx;
-    bullet.dy = dy;
+    int fontSize = 20;
+    Vector2 textSize = MeasureTextEx(GetFontDefault(), button.text, fontSize, 1);
+    Vector2 textPos = {
+        button.rect.x + button.rect.width / 2 - textSize.x / 2,
+        button.rect.y + button.rect.height / 2 - textSize.y / 2
+    };
 
-    return bullet;
+    DrawText(button.text, textPos.x, textPos.y, fontSize, WHITE);
 }
 
-void UpdateBossBullet(BossBullet* bullet) {
-    bullet->x += bullet->dx * bullet->speed;
-    bullet->y += bullet->dy * bullet->speed;
+bool IsButtonHovered(Button button) {
+    return CheckCollisionPointRec(GetMousePosition(), button.rect);
 }
 
-void DrawBossBullet(BossBullet bullet) {
-    DrawCircle(bullet.x, bullet.y, bullet.radius, bullet.color);
-    DrawCircleLines(bullet.x, bullet.y, bullet.radius, BLACK);
+void UpdateButton(Button* button) {
+    if (IsButtonHovered(*button)) {
+        button->currentColor = button->hoverColor;
+    }
+    else {
+        button->currentColor = button->color;
+    }
 }
 
-bool IsBossBulletOffScreen(BossBullet bullet) {
-    return (bullet.x < -bullet.radius || bullet.x > WIDTH + bullet.radius ||
-        bullet.y < -bullet.radius || bullet.y > HEIGHT + bullet.radius);
+// Функции ввода
+void InitInputQueue(InputQueue* queue) {
+    queue->head.store(0);
+    queue->tail.store(0);
+    memset(&queue->lastPushed, 0, sizeof(InputSample));
+    queue->lastPushed.buttons = ~0u;  // Первый снимок всегда попадёт в очередь
+    queue->dropped = 0;
+    queue->held = 0;
+    queue->mouse = { 0, 0 };
 }
 
-// Функции для пуль врагов
-EnemyBullet CreateEnemyBullet(float startX, float startY, float targetX, float targetY) {
-    EnemyBullet bullet;
-    bullet.x = startX;
-    bullet.y = startY;
-    bullet.radius = 6;
-    bullet.speed = 4;
-    bullet.color = ORANGE;
-    bullet.damage = 1;
-
-    float diffX = targetX - startX;
-    float diffY = targetY - startY;
-    float distance = sqrt(diffX * diffX + diffY * diffY);
-    if (distance > 0) {
-        bullet.dx = diffX / distance * bullet.speed;
-        bullet.dy = diffY / distance * bullet.speed;
-    }
-    else {
-        bullet.dx = 0;
-        bullet.dy = bullet.speed;
+bool PushInputSample(InputQueue* queue, InputSample sample) {
+    unsigned int head = queue->head.load(std::memory_order_relaxed);
+    unsigned int tail = queue->tail.load(std::memory_order_acquire);
+    if (head - tail >= INPUT_QUEUE_SIZE) {
+        queue->dropped++;
+        return false;
     }
+    queue->ring[head & (INPUT_QUEUE_SIZE - 1)] = sample;
+    queue->head.store(head + 1, std::memory_order_release);
+    return true;
+}
 
-    return bullet;
+// Самый старый снимок без извлечения; NULL, если очередь пуста
+InputSample* PeekInputSample(InputQueue* queue) {
+    unsigned int tail = queue->tail.load(std::memory_order_relaxed);
+    unsigned int head = queue->head.load(std::memory_order_acquire);
+    if (tail == head) {
+        return NULL;
+    }
+    return &queue->ring[tail & (INPUT_QUEUE_SIZE - 1)];
 }
 
-void UpdateEnemyBullet(EnemyBullet* bullet) {
-    bullet->x += bullet->dx;
-    bullet->y += bullet->dy;
+void PopInputSample(InputQueue* queue) {
+    unsigned int tail = queue->tail.load(std::memory_order_relaxed);
+    queue->tail.store(tail + 1, std::memory_order_release);
 }
 
-void DrawEnemyBullet(EnemyBullet bullet) {
+// Снимает состояние ввода после PollInputEvents; в очередь идут только изменения
+void SampleInput(InputQueue* queue) {
+    InputSample sample;
+    sample.time = GetTime();
+    sample.mouse = GetMousePosition();
+    sample.buttons = 0;
+    if (IsKeyDown(KEY_LEFT)) sample.buttons |= INPUT_BIT(INPUT_LEFT);
+    if (IsKeyDown(KEY_RIGHT)) sample.buttons |= INPUT_BIT(INPUT_RIGHT);
+    if (IsKeyDown(KEY_UP)) sample.buttons |= INPUT_BIT(INPUT_UP);
+    if (IsKeyDown(KEY_DOWN)) sample.buttons |= INPUT_BIT(INPUT_DOWN);
+    if (IsMouseButtonDown(MOUSE_LEFT_BUTTON)) sample.buttons |= INPUT_BIT(INPUT_FIRE);
+    if (IsMouseButtonDown(MOUSE_RIGHT_BUTTON)) sample.buttons |= INPUT_BIT(INPUT_KNIVES);
+    if (IsKeyDown(KEY_ESCAPE)) sample.buttons |= INPUT_BIT(INPUT_BACK);
+    if (IsKeyDown(KEY_F3)) sample.buttons |= INPUT_BIT(INPUT_TOGGLE_PROFILER);
+    if (IsKeyDown(KEY_F4)) sample.buttons |= INPUT_BIT(INPUT_TOGGLE_LATENCY);
+    if (IsKeyDown(KEY_F5)) sample.buttons |= INPUT_BIT(INPUT_TOGGLE_SEPARATION);
+
+    if (sample.buttons == queue->lastPushed.buttons &&
+        sample.mouse.x == queue->lastPushed.mouse.x && sample.mouse.y == queue->lastPushed.mouse.y) {
+        return;
+    }
+    if (PushInputSample(queue, sample)) {
+        queue->lastPushed = sample;
+    }
+}
+
+// Внеочередной опрос посреди кадра, чтобы метки времени не ждали EndDrawing
+void PollAndSampleInput(InputQueue* queue) {
+    PollInputEvents();
+    SampleInput(queue);
+}
+
+// Собирает ввод тика из снимков с меткой времени не позже tickEnd
+TickInput ReadTickInput(InputQueue* queue, double tickEnd) {
+    TickInput input;
+    memset(&input, 0, sizeof(TickInput));
+    bool firePressed = false;
+
+    InputSample* sample = PeekInputSample(queue);
+    while (sample != NULL && sample->time <= tickEnd) {
+        unsigned int rising = sample->buttons & ~queue->held;
+        for (int b = 0; b < INPUT_BUTTON_COUNT; b++) {
+            if ((rising & INPUT_BIT(b)) && !(input.pressed & INPUT_BIT(b))) {
+                input.pressTime[b] = sample->time;
+            }
+        }
+        if ((rising & INPUT_BIT(INPUT_FIRE)) && !firePressed) {
+            input.fireAim = sample->mouse;
+            firePressed = true;
+        }
+        input.pressed |= rising;
+        queue->held = sample->buttons;
+        queue->mouse = sample->mouse;
+
+        PopInputSample(queue);
+        sample = PeekInputSample(queue);
+    }
+
+    input.held = queue->held;
+    input.aim = queue->mouse;
+    if (!firePressed) {
+        input.fireAim = input.aim;
+    }
+    return input;
+}
+
+bool InputPressed(TickInput* input, InputButton button) {
+    return (input->pressed & INPUT_BIT(button)) != 0;
+}
+
+// Зажата на конец тика или нажималась внутри тика
+bool InputDown(TickInput* input, InputButton button) {
+    return ((input->held | input->pressed) & INPUT_BIT(button)) != 0;
+}
+
+// Функции кадрового пейсера
+void InitFramePacer(FramePacer* pacer, double targetHz, PacingStats* stats) {
+    pacer->period = 1.0 / targetHz;
+    pacer->nextDeadline = GetTime() + pacer->period;
+    pacer->spinMargin = PACER_MAX_SPIN;
+    pacer->wakeJitter = PACER_MAX_SPIN;
+    memset(stats, 0, sizeof(PacingStats));
+    stats->targetHz = targetHz;
+}
+
+void RecordPacingError(PacingStats* stats, double error, bool missed) {
+    double us = error * 1000000.0;
+    int bucket = (int)(us / PACING_BUCKET_US);
+    if (bucket < 0) bucket = 0;
+    if (bucket > PACING_BUCKETS) bucket = PACING_BUCKETS;
+    stats->buckets[bucket]++;
+    stats->frames++;
+    stats->sumError += us;
+    if (us > stats->maxError) stats->maxError = us;
+    if (missed) stats->missed++;
+}
+
+// Ждёт дедлайна кадра; пока спим - опрашиваем ввод
+void WaitForNextFrame(FramePacer* pacer, InputQueue* queue, PacingStats* stats) {
+    double deadline = pacer->nextDeadline;
+    double now = GetTime();
+
+    while (deadline - now > pacer->spinMargin) {
+        double sleep = deadline - now - pacer->spinMargin;
+        if (sleep > INPUT_SAMPLE_INTERVAL) sleep = INPUT_SAMPLE_INTERVAL;
+
+        std::this_thread::sleep_for(std::chrono::duration<double>(sleep));
+        double woke = GetTime();
+
+        // Подстраиваем запас под фактический пересып планировщика
+        double overshoot = (woke - now) - sleep;
+        if (overshoot > pacer->wakeJitter) {
+            pacer->wakeJitter = overshoot;
+        }
+        else {
+            pacer->wakeJitter += (overshoot - pacer->wakeJitter) * 0.02;
+        }
+        pacer->spinMargin = pacer->wakeJitter * 1.5;
+        if (pacer->spinMargin < PACER_MIN_SPIN) pacer->spinMargin = PACER_MIN_SPIN;
+        if (pacer->spinMargin > PACER_MAX_SPIN) pacer->spinMargin = PACER_MAX_SPIN;
+
+        PollInputEvents();
+        SampleInput(queue);
+        now = GetTime();
+    }
+
+    // Досыпаем вращением, но ввод и тут опрашиваем с тем же шагом
+    double spinStart = now;
+    double lastSample = now;
+    while (now < deadline) {
+        now = GetTime();
+        if (now - lastSample >= INPUT_SAMPLE_INTERVAL) {
+            PollAndSampleInput(queue);
+            lastSample = now;
+        }
+    }
+    stats->spinTime += now - spinStart;
+
+    // Пропустили целый период - начинаем отсчёт заново, а не догоняем
+    bool missed = now - deadline > pacer->period;
+    RecordPacingError(stats, now - deadline, missed);
+    pacer->nextDeadline = missed ? now + pacer->period : deadline + pacer->period;
+    stats->spinMargin = pacer->spinMargin * 1000000.0;
+    stats->wakeJitter = pacer->wakeJitter * 1000000.0;
+}
+
+double PacingPercentile(PacingStats* stats, double percentile) {
+    if (stats->frames == 0) {
+        return 0.0;
+    }
+    int target = (int)ceil(stats->frames * percentile);
+    int seen = 0;
+    for (int b = 0; b <= PACING_BUCKETS; b++) {
+        seen += stats->buckets[b];
+        if (seen >= target) {
+            double upper = (b + 1) * PACING_BUCKET_US;
+            return (b < PACING_BUCKETS && upper < stats->maxError) ? upper : stats->maxError;
+        }
+    }
+    return stats->maxError;
+}
+
+// Функции планировщика задач
+void LockJobDeque(JobDeque* deque) {
+    while (deque->locked.exchange(true, std::memory_order_acquire)) {
+    }
+}
+
+void UnlockJobDeque(JobDeque* deque) {
+    deque->locked.store(false, std::memory_order_release);
+}
+
+bool PushJob(JobDeque* deque, Job job) {
+    LockJobDeque(deque);
+    bool pushed = deque->bottom - deque->top < JOB_DEQUE_SIZE;
+    if (pushed) {
+        deque->jobs[deque->bottom & (JOB_DEQUE_SIZE - 1)] = job;
+        deque->bottom++;
+    }
+    UnlockJobDeque(deque);
+    return pushed;
+}
+
+bool PopJob(JobDeque* deque, Job* job) {
+    LockJobDeque(deque);
+    bool popped = deque->bottom > deque->top;
+    if (popped) {
+        deque->bottom--;
+        *job = deque->jobs[deque->bottom & (JOB_DEQUE_SIZE - 1)];
+    }
+    UnlockJobDeque(deque);
+    return popped;
+}
+
+bool StealJob(JobDeque* deque, Job* job) {
+    LockJobDeque(deque);
+    bool stolen = deque->bottom > deque->top;
+    if (stolen) {
+        *job = deque->jobs[deque->top & (JOB_DEQUE_SIZE - 1)];
+        deque->top++;
+    }
+    UnlockJobDeque(deque);
+    return stolen;
+}
+
+// Своя задача, иначе крадём у остальных по кругу
+bool TakeJob(JobSystem* system, int index, Job* job) {
+    if (PopJob(&system->deques[index], job)) {
+        return true;
+    }
+    int dequeCount = system->workerCount + 1;
+    for (int k = 1; k < dequeCount; k++) {
+        if (StealJob(&system->deques[(index + k) % dequeCount], job)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void WakeJobWorkers(JobSystem* system) {
+    if (system->workerCount == 0) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(system->sleepMutex);
+        system->generation++;
+    }
+    system->wake.notify_all();
+}
+
+void RunJob(JobSystem* system, int index, Job job);
+
+// Режет фазу на куски и кладёт их в дек потока index
+void EnqueueJobPhase(JobSystem* system, int index, JobPhase* phase) {
+    int chunk = (phase->count < phase->minParallel || system->workerCount == 0) ? phase->count : phase->chunkSize;
+    if (chunk < 1) chunk = 1;
+    int jobCount = phase->count > 0 ? (phase->count + chunk - 1) / chunk : 1;
+    phase->remainingJobs.store(jobCount);
+
+    for (int begin = 0, j = 0; j < jobCount; j++, begin += chunk) {
+        Job job = { phase, begin, begin + chunk < phase->count ? begin + chunk : phase->count };
+        if (!PushJob(&system->deques[index], job)) {
+            RunJob(system, index, job);  // Дек полон - выполняем сразу
+        }
+    }
+    if (jobCount > 1) {
+        WakeJobWorkers(system);
+    }
+}
+
+void RunJob(JobSystem* system, int index, Job job) {
+    JobPhase* phase = job.phase;
+    if (job.end > job.begin) {
+        phase->func(phase->data, job.begin, job.end, index);
+    }
+    if (phase->remainingJobs.fetch_sub(1) != 1) {
+        return;
+    }
+
+    // Последний кусок фазы: освобождаем зависимые фазы
+    JobGraph* graph = system->graph;
+    for (int d = 0; d < phase->dependentCount; d++) {
+        JobPhase* dependent = &graph->phases[phase->dependents[d]];
+        if (dependent->pendingDependencies.fetch_sub(1) == 1) {
+            EnqueueJobPhase(system, index, dependent);
+        }
+    }
+    graph->remainingPhases.fetch_sub(1);
+}
+
+void JobWorkerMain(JobSystem* system, int index) {
+    while (!system->quit.load()) {
+        int seen = system->generation.load();
+        Job job;
+        if (TakeJob(system, index, &job)) {
+            RunJob(system, index, job);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(system->sleepMutex);
+        system->wake.wait(lock, [&] { return system->quit.load() || system->generation.load() != seen; });
+    }
+}
+
+void InitJobSystem(JobSystem* system, int workerCount) {
+    if (workerCount < 0) workerCount = 0;
+    if (workerCount > JOB_MAX_WORKERS) workerCount = JOB_MAX_WORKERS;
+    system->workerCount = workerCount;
+    system->generation.store(0);
+    system->quit.store(false);
+    system->graph = NULL;
+    for (int i = 0; i <= JOB_MAX_WORKERS; i++) {
+        system->deques[i].top = 0;
+        system->deques[i].bottom = 0;
+        system->deques[i].locked.store(false);
+    }
+    for (int i = 0; i < workerCount; i++) {
+        system->threads[i] = std::thread(JobWorkerMain, system, i + 1);
+    }
+    LOG("job system started with %d workers", workerCount);
+}
+
+void ShutdownJobSystem(JobSystem* system) {
+    {
+        std::lock_guard<std::mutex> lock(system->sleepMutex);
+        system->quit.store(true);
+    }
+    system->wake.notify_all();
+    for (int i = 0; i < system->workerCount; i++) {
+        system->threads[i].join();
+    }
+    system->workerCount = 0;
+}
+
+void InitJobGraph(JobGraph* graph) {
+    graph->phaseCount = 0;
+}
+
+// minParallel - минимальное число элементов, с которого фаза режется на куски
+int AddJobPhase(JobGraph* graph, const char* name, JobFunc func, void* data, int count, int minParallel, int chunkSize) {
+    JobPhase* phase = &graph->phases[graph->phaseCount];
+    phase->name = name;
+    phase->func = func;
+    phase->data = data;
+    phase->count = count;
+    phase->minParallel = minParallel;
+    phase->chunkSize = chunkSize;
+    phase->dependentCount = 0;
+    phase->dependencyCount = 0;
+    return graph->phaseCount++;
+}
+
+void AddJobDependency(JobGraph* graph, int phase, int dependsOn) {
+    JobPhase* parent = &graph->phases[dependsOn];
+    parent->dependents[parent->dependentCount++] = phase;
+    graph->phases[phase].dependencyCount++;
+}
+
+// Выполняет граф; главный поток работает наравне с рабочими. system == NULL - всё последовательно
+void RunJobGraph(JobSystem* system, JobGraph* graph) {
+    if (system == NULL) {
+        static JobSystem serial;
+        static bool serialReady = false;
+        if (!serialReady) {
+            InitJobSystem(&serial, 0);
+            serialReady = true;
+        }
+        system = &serial;
+    }
+
+    system->graph = graph;
+    graph->remainingPhases.store(graph->phaseCount);
+    for (int p = 0; p < graph->phaseCount; p++) {
+        graph->phases[p].pendingDependencies.store(graph->phases[p].dependencyCount);
+    }
+    for (int p = 0; p < graph->phaseCount; p++) {
+        if (graph->phases[p].dependencyCount == 0) {
+            EnqueueJobPhase(system, 0, &graph->phases[p]);
+        }
+    }
+
+    // Граф идёт микросекунды, поэтому без задач главный поток не засыпает, а уступает квант
+    while (graph->remainingPhases.load() > 0) {
+        Job job;
+        if (TakeJob(system, 0, &job)) {
+            RunJob(system, 0, job);
+        }
+        else {
+            std::this_thread::yield();
+        }
+    }
+    system->graph = NULL;
+}
+
+// Функции для ножей
+Knife CreateKnife(float startX, float startY, float angle) {
+    Knife knife;
+    knife.x = startX;
+    knife.y = startY;
+    knife.speed = 8;
+    knife.radius = 5;
+    knife.color = RED;
+    knife.directionAngle = angle;
+    knife.distanceTraveled = 0;
+    knife.maxDistance = 200;
+    knife.target = EntityHandle{ 0, 0 };
+    knife.turnRate = 0.12f;
+    knife.prevX = knife.x;
+    knife.prevY = knife.y;
+    return knife;
+}
+
+void UpdateKnife(Knife* knife) {
+    knife->x += cos(knife->directionAngle) * knife->speed;
+    knife->y += sin(knife->directionAngle) * knife->speed;
+    knife->distanceTraveled += knife->speed;
+}
+
+void DrawKnife(Knife knife) {
+    Vector2 points[3] = {
+        {knife.x + 10, knife.y},
+        {knife.x - 3, knife.y + 3},
+        {knife.x - 3, knife.y - 3}
+    };
+
+    for (int i = 0; i < 3; i++) {
+        Vector2 rotated = {
+            knife.x + (points[i].x - knife.x) * cos(knife.directionAngle) - (points[i].y - knife.y) * sin(knife.directionAngle),
+            knife.y + (points[i].x - knife.x) * sin(knife.directionAngle) + (points[i].y - knife.y) * cos(knife.directionAngle)
+        };
+        points[i] = rotated;
+    }
+
+    DrawTriangle(points[0], points[1], points[2], RED);
+    DrawTriangleLines(points[0], points[1], points[2], BLACK);
+}
+
+// Сетка пола в пределах вида и край арены
+#define ARENA_GRID 100
+
+void DrawArena(Rectangle view) {
+    Color grid = { 255, 255, 255, 40 };
+    int firstX = (int)(view.x / ARENA_GRID) * ARENA_GRID;
+    int firstY = (int)(view.y / ARENA_GRID) * ARENA_GRID;
+    for (int x = firstX; x <= view.x + view.width; x += ARENA_GRID) {
+        DrawLine(x, (int)view.y, x, (int)(view.y + view.height), grid);
+    }
+    for (int y = firstY; y <= view.y + view.height; y += ARENA_GRID) {
+        DrawLine((int)view.x, y, (int)(view.x + view.width), y, grid);
+    }
+    DrawRectangleLines(0, 0, WORLD_WIDTH, WORLD_HEIGHT, DARKBLUE);
+}
+
+// Луч пробивает всех, поэтому рисуется на всю дальность
+void DrawLaserBeam(const LaserBeam* laser) {
+    Vector2 end = {
+        laser->origin.x + laser->direction.x * LASER_RANGE,
+        laser->origin.y + laser->direction.y * LASER_RANGE
+    };
+    DrawLineEx(laser->origin, end, 6, Fade(MAGENTA, 0.6f));
+    DrawLineEx(laser->origin, end, 2, WHITE);
+    for (int i = 0; i < laser->hitCount; i++) {
+        DrawCircle((int)(laser->origin.x + laser->direction.x * laser->hits[i].distance),
+            (int)(laser->origin.y + laser->direction.y * laser->hits[i].distance), 4, WHITE);
+    }
+}
+
+// Функции частиц
+void InitParticleSystem(ParticleSystem* system, int budget) {
+    system->count = 0;
+    system->budget = budget < MAX_PARTICLES ? budget : MAX_PARTICLES;
+    system->seed = 2024;
+    system->peak = 0;
+    system->emitted = 0;
+    system->dropped = 0;
+}
+
+float ParticleRandom(ParticleSystem* system) {
+    system->seed = system->seed * 1664525u + 1013904223u;
+    return (system->seed >> 8) * (1.0f / 16777216.0f);
+}
+
+// Доля запрошенных частиц, которую эмиттер выпустит при текущем заполнении
+float ParticleLodScale(const ParticleSystem* system) {
+    float fill = system->budget > 0 ? (float)system->count / system->budget : 1.0f;
+    if (fill <= PARTICLE_LOD_START) {
+        return 1.0f;
+    }
+    float scale = (1.0f - fill) / (1.0f - PARTICLE_LOD_START);
+    return scale > 0 ? scale : 0.0f;
+}
+
+// count частиц во все стороны без LOD; lifeTicks - среднее время жизни
+// Сколько влезло в бюджет, столько и выпускает; возвращает число выпущенных
+int SpawnParticles(ParticleSystem* system, float x, float y, Color color, int count, float speed, int lifeTicks) {
+    if (count > system->budget - system->count) {
+        count = system->budget - system->count;
+    }
+    if (count <= 0) {
+        return 0;
+    }
+    for (int n = 0; n < count; n++) {
+        int i = system->count++;
+        float angle = ParticleRandom(system) * 2 * PI;
+        float velocity = speed * (0.3f + 0.7f * ParticleRandom(system));
+        system->x[i] = x;
+        system->y[i] = y;
+        system->vx[i] = cosf(angle) * velocity;
+        system->vy[i] = sinf(angle) * velocity;
+        system->life[i] = 1.0f;
+        system->decay[i] = 1.0f / (lifeTicks * (0.6f + 0.4f * ParticleRandom(system)));
+        system->size[i] = 2.0f + 2.0f * ParticleRandom(system);
+        system->color[i] = color;
+    }
+    if (system->count > system->peak) {
+        system->peak = system->count;
+    }
+    return count;
+}
+
+// Вспышка эффекта: LOD и бюджет решают, сколько из requested выпустить
+void EmitParticles(ParticleSystem* system, float x, float y, Color color, int requested, float speed, int lifeTicks) {
+    int count = (int)(requested * ParticleLodScale(system) + 0.5f);
+    count = SpawnParticles(system, x, y, color, count, speed, lifeTicks);
+    system->dropped += requested - count;
+    system->emitted += count;
+}
+
+// Один тик: сопротивление, падение и угасание, затем погасшие убираются
+void UpdateParticles(ParticleSystem* system) {
+    int i = 0;
+#ifdef USE_SSE2
+    __m128 drag = _mm_set1_ps(PARTICLE_DRAG);
+    __m128 gravity = _mm_set1_ps(PARTICLE_GRAVITY);
+    for (; i + 4 <= system->count; i += 4) {
+        __m128 vx = _mm_mul_ps(_mm_load_ps(&system->vx[i]), drag);
+        __m128 vy = _mm_add_ps(_mm_mul_ps(_mm_load_ps(&system->vy[i]), drag), gravity);
+        _mm_store_ps(&system->vx[i], vx);
+        _mm_store_ps(&system->vy[i], vy);
+        _mm_store_ps(&system->x[i], _mm_add_ps(_mm_load_ps(&system->x[i]), vx));
+        _mm_store_ps(&system->y[i], _mm_add_ps(_mm_load_ps(&system->y[i]), vy));
+        _mm_store_ps(&system->life[i], _mm_sub_ps(_mm_load_ps(&system->life[i]), _mm_load_ps(&system->decay[i])));
+    }
+#endif
+    for (; i < system->count; i++) {
+        system->vx[i] *= PARTICLE_DRAG;
+        system->vy[i] = system->vy[i] * PARTICLE_DRAG + PARTICLE_GRAVITY;
+        system->x[i] += system->vx[i];
+        system->y[i] += system->vy[i];
+        system->life[i] -= system->decay[i];
+    }
+
+    // На место погасшей встаёт последняя, она уже обновлена
+    for (i = 0; i < system->count; i++) {
+        if (system->life[i] > 0) {
+            continue;
+        }
+        int last = --system->count;
+        system->x[i] = system->x[last];
+        system->y[i] = system->y[last];
+        system->vx[i] = system->vx[last];
+        system->vy[i] = system->vy[last];
+        system->life[i] = system->life[last];
+        system->decay[i] = system->decay[last];
+        system->size[i] = system->size[last];
+        system->color[i] = system->color[last];
+        i--;
+    }
+}
+
+// Все частицы - квадраты в общем буфере rlgl на белой текстуре по
+// умолчанию, без вызова отрисовки на каждую. Позиция откатывается назад
+// по скорости на недошедшую долю тика.
+void DrawParticles(const ParticleSystem* system, float alpha, Rectangle view) {
+    float back = 1.0f - alpha;
+    rlSetTexture(rlGetTextureIdDefault());
+    for (int begin = 0; begin < system->count; begin += PARTICLE_DRAW_CHUNK) {
+        int end = begin + PARTICLE_DRAW_CHUNK < system->count ? begin + PARTICLE_DRAW_CHUNK : system->count;
+        rlCheckRenderBatchLimit((end - begin) * 4);
+        rlBegin(RL_QUADS);
+        for (int i = begin; i < end; i++) {
+            if (!IsInView(view, system->x[i], system->y[i], system->size[i])) {
+                continue;
+            }
+            Color color = system->color[i];
+            rlColor4ub(color.r, color.g, color.b, (unsigned char)(color.a * system->life[i]));
+            float half = system->size[i] * 0.5f;
+            float left = system->x[i] - system->vx[i] * back - half;
+            float top = system->y[i] - system->vy[i] * back - half;
+            float right = left + system->size[i];
+            float bottom = top + system->size[i];
+            rlVertex2f(left, top);
+            rlVertex2f(left, bottom);
+            rlVertex2f(right, bottom);
+            rlVertex2f(right, top);
+        }
+        rlEnd();
+    }
+    rlSetTexture(0);
+}
+
+// Отдельный пул держится у предела: каждый кадр погасшие частицы
+// заменяются новыми. Кадры настоящие, до CloseWindow: в замер отрисовки
+// входит отправка пачки вершин, в замер кадра - ещё и показ.
+void MeasureParticles(ParticleBench* bench) {
+    static ParticleSystem pool;
+    ParticleSystem* system = &pool;
+    InitParticleSystem(system, MAX_PARTICLES);
+    double update = 0, draw = 0, frames = 0, live = 0;
+    for (int frame = 0; frame < PARTICLE_BENCH_FRAMES; frame++) {
+        while (system->count < system->budget) {
+            SpawnParticles(system, ParticleRandom(system) * WIDTH, ParticleRandom(system) * HEIGHT, ORANGE, 500, 4.0f, 90);
+        }
+        live += system->count;
+
+        double frameStart = GetTime();
+        BeginDrawing();
+        ClearBackground(SKYBLUE);
+        double start = GetTime();
+        UpdateParticles(system);
+        update += GetTime() - start;
+        start = GetTime();
+        DrawParticles(system, 1.0f, Rectangle{ 0, 0, (float)WIDTH, (float)HEIGHT });
+        rlDrawRenderBatchActive();
+        draw += GetTime() - start;
+        EndDrawing();
+        frames += GetTime() - frameStart;
+    }
+    bench->liveAvg = live / PARTICLE_BENCH_FRAMES;
+    bench->updateUs = update * 1000000.0 / PARTICLE_BENCH_FRAMES;
+    bench->drawUs = draw * 1000000.0 / PARTICLE_BENCH_FRAMES;
+    bench->frameUs = frames * 1000000.0 / PARTICLE_BENCH_FRAMES;
+}
+
+// Функции регулятора качества
+void InitQualityGovernor(QualityGovernor* governor, double targetFps) {
+    memset(governor, 0, sizeof(QualityGovernor));
+    governor->tier = QUALITY_FULL;
+    governor->budget = 1.0 / targetFps;
+}
+
+void SetQualityTier(QualityGovernor* governor, ParticleSystem* particles, QualityTier tier) {
+    LOG("quality %s -> %s (frame %.2f ms of %.2f)", qualityNames[governor->tier], qualityNames[tier],
+        governor->average * 1000.0, governor->budget * 1000.0);
+    governor->tier = tier;
+    governor->overFrames = 0;
+    governor->underFrames = 0;
+    governor->cooldown = QUALITY_COOLDOWN;
+    governor->changes++;
+    // Живые частицы сверх нового бюджета просто догорают
+    particles->budget = qualityParticleBudgets[tier];
+}
+
+// frameTime - работа кадра без ожидания следующего
+void UpdateQualityGovernor(QualityGovernor* governor, ParticleSystem* particles, double frameTime) {
+    governor->framesAtTier[governor->tier]++;
+    governor->average += (frameTime - governor->average) * QUALITY_SMOOTHING;
+    if (governor->cooldown > 0) {
+        governor->cooldown--;
+        return;
+    }
+
+    if (governor->average > governor->budget * QUALITY_DOWN_SHARE) {
+        governor->underFrames = 0;
+        if (++governor->overFrames >= QUALITY_DOWN_FRAMES && governor->tier < QUALITY_TIER_COUNT - 1) {
+            SetQualityTier(governor, particles, (QualityTier)(governor->tier + 1));
+        }
+    }
+    else if (governor->average < governor->budget * QUALITY_UP_SHARE) {
+        governor->overFrames = 0;
+        if (++governor->underFrames >= QUALITY_UP_FRAMES && governor->tier > QUALITY_FULL) {
+            SetQualityTier(governor, particles, (QualityTier)(governor->tier - 1));
+        }
+    }
+    else {
+        governor->overFrames = 0;
+        governor->underFrames = 0;
+    }
+}
+
+void DrawQualityIndicator(const QualityGovernor* governor) {
+    const Color colors[QUALITY_TIER_COUNT] = { DARKGREEN, GOLD, ORANGE, RED };
+    char text[40];
+    sprintf(text, "Quality: %s", qualityNames[governor->tier]);
+    DrawText(text, 10, 100, 18, colors[governor->tier]);
+}
+
+// Функции вывода кадра
+void SetPresenterScale(Presenter* presenter, float scale) {
+    if (scale < RENDER_SCALE_MIN) scale = RENDER_SCALE_MIN;
+    if (scale > RENDER_SCALE_MAX) scale = RENDER_SCALE_MAX;
+    if (presenter->target.id != 0 && scale == presenter->scale) {
+        return;
+    }
+    if (presenter->target.id != 0) {
+        UnloadRenderTexture(presenter->target);
+        presenter->resizes++;
+    }
+    presenter->scale = scale;
+    presenter->target = LoadRenderTexture((int)(WIDTH * scale + 0.5f), (int)(HEIGHT * scale + 0.5f));
+    SetTextureFilter(presenter->target.texture, presenter->integerScale ? TEXTURE_FILTER_POINT : TEXTURE_FILTER_BILINEAR);
+    LOG("render target %dx%d", presenter->target.texture.width, presenter->target.texture.height);
+}
+
+void InitPresenter(Presenter* presenter, float scale, bool integerScale) {
+    memset(presenter, 0, sizeof(Presenter));
+    presenter->integerScale = integerScale;
+    presenter->baseScale = scale;
+    SetPresenterScale(presenter, scale);
+}
+
+void UnloadPresenter(Presenter* presenter) {
+    if (presenter->target.id != 0) {
+        UnloadRenderTexture(presenter->target);
+    }
+    presenter->target.id = 0;
+}
+
+// Раз в кадр до отрисовки: масштаб по ступени качества, место в окне и пересчёт мыши
+void UpdatePresenter(Presenter* presenter, QualityTier tier) {
+    SetPresenterScale(presenter, presenter->baseScale * qualityRenderScales[tier]);
+
+    float width = (float)presenter->target.texture.width;
+    float height = (float)presenter->target.texture.height;
+    float screenWidth = (float)GetScreenWidth();
+    float screenHeight = (float)GetScreenHeight();
+    float fit = fminf(screenWidth / width, screenHeight / height);
+    // Целое увеличение, пока окно не меньше текстуры; иначе только сжатие
+    if (presenter->integerScale && fit >= 1.0f) fit = floorf(fit);
+    presenter->dest.width = width * fit;
+    presenter->dest.height = height * fit;
+    presenter->dest.x = floorf((screenWidth - presenter->dest.width) / 2);
+    presenter->dest.y = floorf((screenHeight - presenter->dest.height) / 2);
+
+    // GetMousePosition отдаёт логические координаты, как раньше
+    SetMouseOffset(-(int)presenter->dest.x, -(int)presenter->dest.y);
+    SetMouseScale(WIDTH / presenter->dest.width, HEIGHT / presenter->dest.height);
+}
+
+// Между BeginDrawing и EndDrawing: поля по краям и кадр одним растяжением
+void PresentFrame(const Presenter* presenter) {
+    ClearBackground(BLACK);
+    Texture2D texture = presenter->target.texture;
+    // Текстура цели перевёрнута по вертикали
+    Rectangle source = { 0, 0, (float)texture.width, -(float)texture.height };
+    DrawTexturePro(texture, source, presenter->dest, Vector2{ 0, 0 }, 0.0f, WHITE);
+}
+
+bool IsKnifeOutsideWorld(Knife knife) {
+    return (knife.x < -20 || knife.x > WORLD_WIDTH + 20 ||
+        knife.y < -20 || knife.y > WORLD_HEIGHT + 20 ||
+        knife.distanceTraveled >= knife.maxDistance);
+}
+
+// Функции для бонусов
+HatBonus CreateHatBonus(float startX, float startY, const char* type) {
+    HatBonus bonus;
+    bonus.x = startX;
+    bonus.y = startY;
+    bonus.width = 30;
+    bonus.height = 25;
+    bonus.speed = 2;
+    bonus.collected = false;
+    bonus.lifetime = 300;
+    strcpy(bonus.bonusType, type);
+
+    if (strcmp(type, "damage") == 0) {
+        bonus.color = GOLD;
+    }
+    else if (strcmp(type, "laser") == 0) {
+        bonus.color = MAGENTA;
+    }
+    else {
+        bonus.color = RED;
+    }
+    bonus.prevX = bonus.x;
+    bonus.prevY = bonus.y;
+    return bonus;
+}
+
+void UpdateHatBonus(HatBonus* bonus) {
+    bonus->y += bonus->speed;
+}
+
+void DrawHatBonus(HatBonus bonus) {
+    DrawRectangle(bonus.x - bonus.width / 2, bonus.y, bonus.width, 10, bonus.color);
+    DrawRectangle(bonus.x - bonus.width / 3, bonus.y - 15, bonus.width / 1.5f, 15, bonus.color);
+
+    const char* bonusName = "KNIVES";
+    Color textColor = WHITE;
+    if (strcmp(bonus.bonusType, "damage") == 0) {
+        bonusName = "DMG x2";
+        textColor = BLACK;
+    }
+    else if (strcmp(bonus.bonusType, "laser") == 0) {
+        bonusName = "LASER";
+    }
+    int textWidth = MeasureText(bonusName, 12);
+    DrawText(bonusName, bonus.x - textWidth / 2, bonus.y - 30, 12, textColor);
+}
+
+bool ShouldRemoveBonus(HatBonus bonus) {
+    return bonus.y > WORLD_HEIGHT;
+}
+
+bool BonusCollidesWithPlayer(HatBonus bonus, Player player) {
+    float distance = sqrt(pow(bonus.x - player.x, 2) + pow(bonus.y - player.y, 2));
+    return distance < (bonus.width / 2 + player.radius);
+}
+
+// Функции для игрока
+Player CreatePlayer() {
+    Player player;
+    player.x = WORLD_WIDTH / 2;
+    player.y = WORLD_HEIGHT - 50;
+    player.radius = 20;
+    player.speed = 5;
+    player.color = BLUE;
+    player.health = 10;
+    player.lives = 1;
+    player.invincible = false;
+    player.damageMultiplier = 1;
+    player.hasKnifeBonus = false;
+    player.hasLaser = false;
+    player.shootReadyTick = 0;
+    player.prevX = player.x;
+    player.prevY = player.y;
+    return player;
+}
+
+// aim - курсор в координатах арены, за ним следят зрачки
+void DrawPlayer(Player player, Vector2 aim) {
+    DrawLine(player.x - 8, player.y + player.radius, player.x - 12, player.y + player.radius + 15, BLACK);
+    DrawLine(player.x + 8, player.y + player.radius, player.x + 12, player.y + player.radius + 15, BLACK);
+
+    DrawLine(player.x - 12, player.y, player.x - 12 - 18, player.y + 5, BLACK);
+    DrawLine(player.x + 12, player.y, player.x + 12 + 18, player.y + 5, BLACK);
+
+    Color bodyColor = player.invincible ? RED : player.color;
+    DrawCircle(player.x, player.y, player.radius, bodyColor);
+
+    Color hatColor;
+    if (player.hasKnifeBonus) {
+        hatColor = RED;
+    }
+    else if (player.hasLaser) {
+        hatColor = MAGENTA;
+    }
+    else if (player.damageMultiplier > 1) {
+        hatColor = GOLD;
+    }
+    else {
+        hatColor = DARKBLUE;
+    }
+
+    DrawRectangle(player.x - 25, player.y - player.radius - 20, 50, 15, hatColor);
+    DrawRectangle(player.x - 15, player.y - player.radius - 35, 30, 20, hatColor);
+
+    DrawCircle(player.x - 8, player.y - 5, 5, WHITE);
+    DrawCircle(player.x + 8, player.y - 5, 5, WHITE);
+
+    float dx = aim.x - player.x;
+    float dy = aim.y - player.y;
+    float distance = sqrt(dx * dx + dy * dy);
+    if (distance > 0) {
+        dx /= distance;
+        dy /= distance;
+    }
+
+    DrawCircle(player.x - 8 + dx * 2, player.y - 5 + dy * 2, 2, BLACK);
+    DrawCircle(player.x + 8 + dx * 2, player.y - 5 + dy * 2, 2, BLACK);
+
+    if (player.health <= 3) {
+        Vector2 mouthPoints[3] = {
+            {player.x - 8, player.y + 3},
+            {player.x + 8, player.y + 3},
+            {player.x, player.y + 13}
+        };
+        DrawTriangle(mouthPoints[0], mouthPoints[1], mouthPoints[2], BLACK);
+    }
+    else if (player.invincible) {
+        Vector2 mouthPoints[3] = {
+            {player.x - 8, player.y + 13},
+            {player.x + 8, player.y + 13},
+            {player.x, player.y + 3}
+        };
+        DrawTriangle(mouthPoints[0], mouthPoints[1], mouthPoints[2], RED);
+    }
+    else {
+        DrawLine(player.x - 6, player.y + 5, player.x + 6, player.y + 5, BLACK);
+    }
+
+    DrawRectangle(player.x - 20, player.y - player.radius - 10, 40, 6, RED);
+    DrawRectangle(player.x - 20, player.y - player.radius - 10, 40 * (player.health / 10.0f), 6, GREEN);
+}
+
+void MovePlayer(Player* player, TickInput* input) {
+    if (InputDown(input, INPUT_LEFT) && player->x - player->radius > 0) {
+        player->x -= player->speed;
+    }
+    if (InputDown(input, INPUT_RIGHT) && player->x + player->radius < WORLD_WIDTH) {
+        player->x += player->speed;
+    }
+    if (InputDown(input, INPUT_UP) && player->y - player->radius > 0) {
+        player->y -= player->speed;
+    }
+    if (InputDown(input, INPUT_DOWN) && player->y + player->radius < WORLD_HEIGHT) {
+        player->y += player->speed;
+    }
+}
+
+bool PlayerTakeDamage(Player* player, int damage) {
+    if (!player->invincible) {
+        player->health -= damage;
+        player->invincible = true;
+
+        if (player->health <= 0) {
+            player->lives--;
+            player->health = 0;
+            player->damageMultiplier = 1;
+            player->hasKnifeBonus = false;
+            player->hasLaser = false;
+            return true;
+        }
+    }
+    return false;
+}
+
+void AddDamageBonus(Player* player) {
+    player->damageMultiplier = 2;
+    player->hasKnifeBonus = false;
+    player->hasLaser = false;
+}
+
+void AddKnifeBonus(Player* player) {
+    player->hasKnifeBonus = true;
+    player->damageMultiplier = 1;
+    player->hasLaser = false;
+}
+
+void AddLaserBonus(Player* player) {
+    player->hasLaser = true;
+    player->hasKnifeBonus = false;
+    player->damageMultiplier = 1;
+}
+
+bool IsPlayerAlive(Player player) {
+    return player.lives > 0 && player.health > 0;
+}
+
+void CreatePlayerKnives(Player player, Knife knives[], int* knifeCount) {
+    for (int i = 0; i < 10; i++) {
+        if (*knifeCount < MAX_KNIVES) {
+            float angle = i * 36 * PI / 180.0f;
+            knives[*knifeCount] = CreateKnife(player.x, player.y, angle);
+            (*knifeCount)++;
+        }
+    }
+}
+
+// Функции для пуль
+Bullet CreateBullet(float startX, float startY, float targetX, float targetY, int level, int damageMultiplier) {
+    Bullet bullet;
+    bullet.x = startX;
+    bullet.y = startY;
+    bullet.radius = 8;
+    bullet.speed = 7 + level;
+
+    if (level == 1) bullet.color = GREEN;
+    else if (level == 2) bullet.color = YELLOW;
+    else bullet.color = PURPLE;
+
+    bullet.damage = 3 * damageMultiplier;
+
+    float diffX = targetX - startX;
+    float diffY = targetY - startY;
+    float distance = sqrt(diffX * diffX + diffY * diffY);
+    if (distance > 0) {
+        bullet.dx = diffX / distance * bullet.speed;
+        bullet.dy = diffY / distance * bullet.speed;
+    }
+    else {
+        bullet.dx = 0;
+        bullet.dy = -bullet.speed;
+    }
+
+    bullet.prevX = bullet.x;
+    bullet.prevY = bullet.y;
+    return bullet;
+}
+
+void UpdateBullet(Bullet* bullet) {
+    bullet->x += bullet->dx;
+    bullet->y += bullet->dy;
+}
+
+void DrawBullet(Bullet bullet) {
     DrawCircle(bullet.x, bullet.y, bullet.radius, bullet.color);
     DrawCircleLines(bullet.x, bullet.y, bullet.radius, BLACK);
 }
 
-bool IsEnemyBulletOffScreen(EnemyBullet bullet) {
-    return (bullet.x < -bullet.radius || bullet.x > WIDTH + bullet.radius ||
-        bullet.y < -bullet.radius || bullet.y > HEIGHT + bullet.radius);
+bool IsBulletOutsideWorld(Bullet bullet) {
+    return (bullet.x < -bullet.radius || bullet.x > WORLD_WIDTH + bullet.radius ||
+        bullet.y < -bullet.radius || bullet.y > WORLD_HEIGHT + bullet.radius);
+}
+
+// Столкновение двух кругов за тик: оба движутся по прямой от прошлой позиции
+// к текущей, ищем момент наибольшего сближения. Быстрый снаряд не проскочит
+// сквозь маленькую цель даже при редких тиках.
+bool SweptCirclesCollide(Vector2 fromA, Vector2 toA, Vector2 fromB, Vector2 toB, float radius) {
+    float px = fromA.x - fromB.x;
+    float py = fromA.y - fromB.y;
+    float vx = (toA.x - fromA.x) - (toB.x - fromB.x);
+    float vy = (toA.y - fromA.y) - (toB.y - fromB.y);
+    float lengthSq = vx * vx + vy * vy;
+    float t = 0;
+    if (lengthSq > 0) {
+        t = -(px * vx + py * vy) / lengthSq;
+        if (t < 0) t = 0;
+        if (t > 1) t = 1;
+    }
+    float cx = px + vx * t;
+    float cy = py + vy * t;
+    return cx * cx + cy * cy < radius * radius;
+}
+
+// Функции для снарядов
+float Interpolate(float prev, float current, float alpha) {
+    return prev + (current - prev) * alpha;
+}
+
+// Путь за steps шагов. Скорость шага k - speed + k * accel, но не меньше PROJECTILE_MIN_SPEED.
+float ProjectileDistance(const Projectile* projectile, int steps) {
+    if (steps <= 0) {
+        return 0;
+    }
+    float speed = projectile->speed;
+    float accel = projectile->accel;
+    if (accel >= 0) {
+        return steps * speed + accel * steps * (steps + 1) / 2;
+    }
+    // Замедляется до минимальной скорости и дальше летит с ней
+    int slowing = (int)((speed - PROJECTILE_MIN_SPEED) / -accel);
+    if (slowing > steps) slowing = steps;
+    return slowing * speed + accel * slowing * (slowing + 1) / 2 + (steps - slowing) * PROJECTILE_MIN_SPEED;
+}
+
+Vector2 ProjectilePosition(Projectile projectile, int tick) {
+    float distance = ProjectileDistance(&projectile, tick - projectile.launchTick);
+    return { projectile.originX + projectile.dx * distance, projectile.originY + projectile.dy * distance };
+}
+
+// Позиция между тиками для отрисовки
+Vector2 ProjectileDrawPosition(Projectile projectile, int tick, float alpha) {
+    Vector2 from = ProjectilePosition(projectile, tick - 1);
+    Vector2 to = ProjectilePosition(projectile, tick);
+    return { Interpolate(from.x, to.x, alpha), Interpolate(from.y, to.y, alpha) };
+}
+
+// Снаряд, выпущенный на тике tick, делает первый шаг в этом же тике
+void LaunchProjectile(Projectile* projectile, float x, float y, float dx, float dy, float speed, float accel, float radius, int tick) {
+    projectile->originX = x;
+    projectile->originY = y;
+    projectile->dx = dx;
+    projectile->dy = dy;
+    projectile->speed = speed > PROJECTILE_MIN_SPEED ? speed : PROJECTILE_MIN_SPEED;
+    projectile->accel = accel;
+    projectile->launchTick = tick - 1;
+
+    // Путь до края арены с учётом радиуса
+    float exit = 1e9f;
+    if (dx > 0) exit = fminf(exit, (WORLD_WIDTH + radius - x) / dx);
+    if (dx < 0) exit = fminf(exit, (-radius - x) / dx);
+    if (dy > 0) exit = fminf(exit, (WORLD_HEIGHT + radius - y) / dy);
+    if (dy < 0) exit = fminf(exit, (-radius - y) / dy);
+    if (exit < 0) exit = 0;
+
+    // Первый шаг, на котором путь больше exit; путь растёт не медленнее PROJECTILE_MIN_SPEED за шаг
+    int low = 1;
+    int high = (int)(exit / PROJECTILE_MIN_SPEED) + 2;
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (ProjectileDistance(projectile, middle) > exit) {
+            high = middle;
+        }
+        else {
+            low = middle + 1;
+        }
+    }
+    projectile->despawnTick = projectile->launchTick + low;
+}
+
+// Функции для пуль босса
+BossBullet CreateBossBullet(float startX, float startY, float dx, float dy, float speed, float accel, int tick) {
+    BossBullet bullet;
+    bullet.radius = 8;
+    bullet.color = { 255, 50, 50, 255 };
+    bullet.damage = 2;
+    LaunchProjectile(&bullet.motion, startX, startY, dx, dy, speed, accel, bullet.radius, tick);
+    return bullet;
+}
+
+void DrawBossBullet(BossBullet bullet, Vector2 position) {
+    DrawCircle(position.x, position.y, bullet.radius, bullet.color);
+    DrawCircleLines(position.x, position.y, bullet.radius, BLACK);
+}
+
+// Функции для пуль врагов
+EnemyBullet CreateEnemyBullet(float startX, float startY, float dx, float dy, float speed, float accel, int tick) {
+    EnemyBullet bullet;
+    bullet.radius = 6;
+    bullet.color = ORANGE;
+    bullet.damage = 1;
+    LaunchProjectile(&bullet.motion, startX, startY, dx, dy, speed, accel, bullet.radius, tick);
+    return bullet;
+}
+
+void DrawEnemyBullet(EnemyBullet bullet, Vector2 position) {
+    DrawCircle(position.x, position.y, bullet.radius, bullet.color);
+    DrawCircleLines(position.x, position.y, bullet.radius, BLACK);
+}
+
+bool ProjectileCollidesWithPlayer(Projectile projectile, float radius, Player player, int now) {
+    return SweptCirclesCollide(ProjectilePosition(projectile, now - 1), ProjectilePosition(projectile, now),
+        Vector2{ player.prevX, player.prevY }, Vector2{ player.x, player.y }, radius + player.radius);
+}
+
+// Компилятор паттернов
+const char* patternSources[PATTERN_COUNT] = {
+    // Веерная атака
+    "speed 5; ring 12; wait 40",
+    // Спиральная атака
+    "speed 5; repeat 0; ring 8; rotate 200; wait 20; end",
+    // Прицельная атака + веер
+    "speed 5; fan 3 22.6 90; ring 8 -20; wait 50",
+    // Стрелок бьёт по игроку
+    "speed 4; aim; fan 1 0; wait 90",
+};
+const char* patternNames[PATTERN_COUNT] = { "boss_wave", "boss_spiral", "boss_targeted", "shooter_aimed" };
+
+// Направления N пуль от angle с шагом step (градусы) в общую таблицу
+int AddPatternDirections(PatternLibrary* library, int count, float angle, float step) {
+    if (library->directionCount + count > PATTERN_MAX_DIRECTIONS) {
+        return -1;
+    }
+    int table = library->directionCount;
+    for (int i = 0; i < count; i++) {
+        float radians = (angle + i * step) * PI / 180.0f;
+        library->directions[table + i] = { cosf(radians), sinf(radians) };
+    }
+    library->directionCount += count;
+    return table;
+}
+
+// Ошибка компиляции пишется в журнал, паттерн остаётся пустым
+bool CompilePattern(PatternLibrary* library, BulletPattern* pattern, const char* name, const char* source) {
+    pattern->name = name;
+    pattern->opCount = 0;
+    int loopStart[PATTERN_MAX_DEPTH];
+    int depth = 0;
+    int statement = 0;
+
+    const char* p = source;
+    while (*p != 0) {
+        // Оператор до ';' или конца строки
+        char text[64];
+        int length = 0;
+        while (*p != 0 && *p != ';' && *p != '\n') {
+            if (length < (int)sizeof(text) - 1) text[length++] = *p;
+            p++;
+        }
+        if (*p != 0) p++;
+        text[length] = 0;
+        statement++;
+
+        char word[16];
+        float args[3] = { 0, 0, 0 };
+        int argCount = sscanf(text, "%15s %f %f %f", word, &args[0], &args[1], &args[2]) - 1;
+        if (argCount < 0) {
+            continue;
+        }
+        if (pattern->opCount >= PATTERN_MAX_OPS) {
+            LOG("pattern %s: too many operations", name);
+            pattern->opCount = 0;
+            return false;
+        }
+
+        PatternOp op = {};
+        bool ok = true;
+        if (strcmp(word, "speed") == 0 && argCount >= 1) {
+            op.op = PATTERN_OP_SPEED;
+            op.value = args[0];
+            op.accel = args[1];
+        }
+        else if (strcmp(word, "ring") == 0 && argCount >= 1 && args[0] >= 1) {
+            op.op = PATTERN_OP_EMIT;
+            op.count = (short)args[0];
+            op.table = AddPatternDirections(library, op.count, args[1], 360.0f / op.count);
+            ok = op.table >= 0;
+        }
+        else if (strcmp(word, "fan") == 0 && argCount >= 2 && args[0] >= 1) {
+            op.op = PATTERN_OP_EMIT;
+            op.count = (short)args[0];
+            float step = op.count > 1 ? args[1] / (op.count - 1) : 0.0f;
+            op.table = AddPatternDirections(library, op.count, args[2] - args[1] / 2, step);
+            ok = op.table >= 0;
+        }
+        else if (strcmp(word, "aim") == 0) {
+            op.op = PATTERN_OP_AIM;
+        }
+        else if (strcmp(word, "rotate") == 0 && argCount >= 1) {
+            op.op = PATTERN_OP_ROTATE;
+            op.value = args[0] * PI / 180.0f;
+        }
+        else if (strcmp(word, "angle") == 0 && argCount >= 1) {
+            op.op = PATTERN_OP_ANGLE;
+            op.value = args[0] * PI / 180.0f;
+        }
+        else if (strcmp(word, "wait") == 0 && argCount >= 1 && args[0] >= 1) {
+            op.op = PATTERN_OP_WAIT;
+            op.count = (short)args[0];
+        }
+        else if (strcmp(word, "repeat") == 0 && argCount >= 1 && depth < PATTERN_MAX_DEPTH) {
+            op.op = PATTERN_OP_REPEAT;
+            op.count = (short)args[0];
+            loopStart[depth++] = pattern->opCount + 1;
+        }
+        else if (strcmp(word, "end") == 0 && depth > 0) {
+            op.op = PATTERN_OP_END;
+            op.jump = (short)loopStart[--depth];
+        }
+        else {
+            ok = false;
+        }
+
+        if (!ok) {
+            LOG("pattern %s: bad statement %d", name, statement);
+            pattern->opCount = 0;
+            return false;
+        }
+        pattern->ops[pattern->opCount++] = op;
+    }
+
+    if (depth != 0) {
+        LOG("pattern %s: repeat without end", name);
+        pattern->opCount = 0;
+        return false;
+    }
+    return true;
+}
+
+bool CompilePatternLibrary(PatternLibrary* library) {
+    library->directionCount = 0;
+    bool ok = true;
+    for (int i = 0; i < PATTERN_COUNT; i++) {
+        ok = CompilePattern(library, &library->patterns[i], patternNames[i], patternSources[i]) && ok;
+    }
+    return ok;
+}
+
+void StartPattern(PatternState* state, PatternId pattern) {
+    state->pattern = (unsigned char)pattern;
+    state->pc = 0;
+    state->depth = 0;
+    state->angle = 0;
+    state->speed = 1;
+    state->accel = 0;
+}
+
+// Поле направлений
+// Отрицательные всё равно прижимаются к нулю, так что хватает усечения вместо floorf
+int FlowColumn(float x) {
+    int col = (int)(x / FLOW_CELL);
+    return col < 0 ? 0 : (col >= FLOW_COLS ? FLOW_COLS - 1 : col);
+}
+
+int FlowRow(float y) {
+    int row = (int)(y / FLOW_CELL);
+    return row < 0 ? 0 : (row >= FLOW_ROWS ? FLOW_ROWS - 1 : row);
+}
+
+void InitFlowField(FlowField* flow) {
+    memset(flow, 0, sizeof(FlowField));
+    flow->targetCol = -1;
+    flow->targetRow = -1;
+}
+
+// Смена клетки игрока только открывает новую сборку: клетки досчитываются
+// при первой выборке, так что работа идёт лишь там, где стоят враги.
+// Препятствий пока нет, и центр клетки смотрит прямо на игрока; обход
+// препятствий ляжет сюда же поиском в ширину от клетки игрока.
+void UpdateFlowField(FlowField* flow, Player player) {
+    int targetCol = FlowColumn(player.x);
+    int targetRow = FlowRow(player.y);
+    if (targetCol == flow->targetCol && targetRow == flow->targetRow) {
+        return;
+    }
+    flow->targetCol = targetCol;
+    flow->targetRow = targetRow;
+    flow->target = Vector2{ player.x, player.y };
+    flow->builds++;
+}
+
+Vector2 FlowCellDirection(FlowField* flow, int col, int row) {
+    FlowCell* cell = &flow->cells[row][col];
+    if (cell->stamp != flow->builds) {
+        float dx = flow->target.x - (col + 0.5f) * FLOW_CELL;
+        float dy = flow->target.y - (row + 0.5f) * FLOW_CELL;
+        float distance = sqrtf(dx * dx + dy * dy);
+        cell->direction = distance > 0 ? Vector2{ dx / distance, dy / distance } : Vector2{ 0, 0 };
+        cell->stamp = flow->builds;
+        flow->cellsBuilt++;
+    }
+    return cell->direction;
+}
+
+// Направление к игроку для врага в точке (x, y). Рядом с игроком клетки
+// слишком грубые, там враг целится напрямую.
+Vector2 SampleFlowField(FlowField* flow, float x, float y, Player player) {
+    int col = FlowColumn(x);
+    int row = FlowRow(y);
+    if (abs(col - flow->targetCol) > FLOW_DIRECT_RANGE || abs(row - flow->targetRow) > FLOW_DIRECT_RANGE) {
+        flow->lookups++;
+        return FlowCellDirection(flow, col, row);
+    }
+    flow->direct++;
+    float dx = player.x - x;
+    float dy = player.y - y;
+    float distance = sqrt(dx * dx + dy * dy);
+    return distance > 0 ? Vector2{ dx / distance, dy / distance } : Vector2{ 0, 0 };
+}
+
+// Свой генератор замера, чтобы не сбивать сид игры
+float BenchRandom(unsigned int* seed, float range) {
+    *seed = *seed * 1664525u + 1013904223u;
+    return (*seed >> 8) * (1.0f / 16777216.0f) * range;
+}
+
+// Синтетическая толпа дрейфует по арене, игрок ходит по кругу со своей скоростью.
+// pass 0 - только движение, 1 - поле, 2 - нормировка каждым врагом.
+double RunFlowBenchPass(FlowField* flow, int pass, Vector2 steer[], int count) {
+    static Vector2 positions[MAX_ENEMIES], velocities[MAX_ENEMIES];
+    unsigned int seed = 4242;
+    for (int i = 0; i < count; i++) {
+        positions[i] = { BenchRandom(&seed, WORLD_WIDTH), BenchRandom(&seed, WORLD_HEIGHT) };
+        velocities[i] = { BenchRandom(&seed, 4) - 2, BenchRandom(&seed, 4) - 2 };
+    }
+    InitFlowField(flow);
+
+    double start = GetTime();
+    for (int t = 0; t < FLOW_BENCH_TICKS; t++) {
+        float angle = t * 5.0f / 600.0f;
+        Player player;
+        player.x = WORLD_WIDTH / 2 + cosf(angle) * 600.0f;
+        player.y = WORLD_HEIGHT / 2 + sinf(angle) * 600.0f;
+        for (int i = 0; i < count; i++) {
+            positions[i].x += velocities[i].x;
+            positions[i].y += velocities[i].y;
+            if (positions[i].x < 0 || positions[i].x > WORLD_WIDTH) velocities[i].x = -velocities[i].x;
+            if (positions[i].y < 0 || positions[i].y > WORLD_HEIGHT) velocities[i].y = -velocities[i].y;
+        }
+        if (pass == 1) {
+            UpdateFlowField(flow, player);
+            for (int i = 0; i < count; i++) {
+                steer[i] = SampleFlowField(flow, positions[i].x, positions[i].y, player);
+            }
+        }
+        else if (pass == 2) {
+            for (int i = 0; i < count; i++) {
+                float dx = player.x - positions[i].x;
+                float dy = player.y - positions[i].y;
+                float distance = sqrtf(dx * dx + dy * dy);
+                steer[i] = distance > 0 ? Vector2{ dx / distance, dy / distance } : Vector2{ 0, 0 };
+            }
+        }
+    }
+    return GetTime() - start;
+}
+
+void MeasureFlowField(FlowBench* bench) {
+    static FlowField flow;
+    static Vector2 viaField[MAX_ENEMIES], direct[MAX_ENEMIES];
+    double moveTime = RunFlowBenchPass(&flow, 0, direct, MAX_ENEMIES);
+    double directTime = RunFlowBenchPass(&flow, 2, direct, MAX_ENEMIES);
+    double flowTime = RunFlowBenchPass(&flow, 1, viaField, MAX_ENEMIES);
+
+    bench->enemies = MAX_ENEMIES;
+    bench->flowUsPerTick = fmax(flowTime - moveTime, 0.0) * 1000000.0 / FLOW_BENCH_TICKS;
+    bench->directUsPerTick = fmax(directTime - moveTime, 0.0) * 1000000.0 / FLOW_BENCH_TICKS;
+    bench->cellsPerTick = (double)flow.cellsBuilt / FLOW_BENCH_TICKS;
+    // Обе последние выборки сделаны в одних и тех же точках
+    bench->maxError = 0;
+    for (int i = 0; i < MAX_ENEMIES; i++) {
+        bench->maxError = fmaxf(bench->maxError, fmaxf(fabsf(viaField[i].x - direct[i].x), fabsf(viaField[i].y - direct[i].y)));
+    }
+}
+
+// Функции для врагов
+// Место появления задаётся относительно вида: враги входят сверху кадра
+Enemy CreateEnemy(int enemyLevel, bool elite, bool boss, bool shooter, bool tank, bool runner, Player player, Rectangle view) {
+    Enemy enemy;
+    enemy.level = enemyLevel;
+    enemy.isElite = elite;
+    enemy.isBoss = boss;
+    enemy.isShooter = shooter;
+    enemy.isTank = tank;
+    enemy.isRunner = runner;
+    enemy.attackReadyTick = 0;
+    enemy.lastThinkTick = -1;
+    enemy.shootCooldown = 0;
+    enemy.hasStopped = false;
+    enemy.isFar = false;
+    enemy.attackPattern = 0;
+    StartPattern(&enemy.pattern, boss ? PATTERN_BOSS_WAVE : PATTERN_SHOOTER_AIMED);
+
+    if (boss) {
+        enemy.radius = 50;
+        enemy.speed = 1;
+        enemy.color = PURPLE;
+        enemy.health = 200;
+        enemy.damage = 3;
+        enemy.scoreValue = 500;
+        enemy.x = WIDTH / 2;
+        enemy.y = -100;
+        enemy.shootCooldown = 30;
+    }
+    else if (shooter) {
+        enemy.radius = 18;
+        enemy.speed = 1.5f;
+        enemy.color = { 0, 255, 255, 255 }; // Голубой
+        enemy.health = 15;
+        enemy.damage = 1;
+        enemy.scoreValue = 25;
+        enemy.x = GetRandomValue(enemy.radius, WIDTH - enemy.radius);
+        enemy.y = -enemy.radius;
+        enemy.shootCooldown = 90; // Стреляет раз в 1.5 секунды
+    }
+    else if (tank) {
+        enemy.radius = 35;
+        enemy.speed = 0.8f;
+        enemy.color = { 100, 100, 100, 255 }; // Серый
+        enemy.health = 50;
+        enemy.damage = 2;
+        enemy.scoreValue = 40;
+        enemy.x = GetRandomValue(enemy.radius, WIDTH - enemy.radius);
+        enemy.y = -enemy.radius;
+    }
+    else if (runner) {
+        enemy.radius = 12;
+        enemy.speed = 4.0f;
+        enemy.color = { 255, 105, 180, 255 }; // Розовый
+        enemy.health = 10;
+        enemy.damage = 1;
+        enemy.scoreValue = 15;
+        enemy.x = GetRandomValue(enemy.radius, WIDTH - enemy.radius);
+        enemy.y = -enemy.radius;
+    }
+    else if (elite) {
+        enemy.radius = 30;
+        enemy.speed = 1.5;
+        enemy.color = GOLD;
+        enemy.health = 25;
+        enemy.damage = 2;
+        enemy.scoreValue = 50;
+        enemy.x = GetRandomValue(enemy.radius, WIDTH - enemy.radius);
+        enemy.y = -enemy.radius;
+    }
+    else if (enemyLevel == 1) {
+        enemy.radius = 15;
+        enemy.speed = 2;
+        enemy.color = RED;
+        enemy.health = 15;
+        enemy.damage = 1;
+        enemy.scoreValue = 10;
+        enemy.x = GetRandomValue(enemy.radius, WIDTH - enemy.radius);
+        enemy.y = -enemy.radius;
+    }
+    else if (enemyLevel == 2) {
+        enemy.radius = 20;
+        enemy.speed = 2.5;
+        enemy.color = ORANGE;
+        enemy.health = 20;
+        enemy.damage = 1;
+        enemy.scoreValue = 20;
+        enemy.x = GetRandomValue(enemy.radius, WIDTH - enemy.radius);
+        enemy.y = -enemy.radius;
+    }
+    else {
+        enemy.radius = 25;
+        enemy.speed = 3;
+        enemy.color = { 139, 0, 0, 255 };
+        enemy.health = 25;
+        enemy.damage = 2;
+        enemy.scoreValue = 30;
+        enemy.x = GetRandomValue(enemy.radius, WIDTH - enemy.radius);
+        enemy.y = -enemy.radius;
+    }
+    enemy.x += view.x;
+    enemy.y += view.y;
+    enemy.stopY = view.y + (boss ? 100 : 150);
+
+    float dx = player.x - enemy.x;
+    float dy = player.y - enemy.y;
+    float distance = sqrt(dx * dx + dy * dy);
+    if (distance > 0) {
+        enemy.dx = dx / distance * enemy.speed;
+        enemy.dy = dy / distance * enemy.speed;
+    }
+    else {
+        enemy.dx = 0;
+        enemy.dy = enemy.speed;
+    }
+
+    enemy.prevX = enemy.x;
+    enemy.prevY = enemy.y;
+    return enemy;
+}
+
+void DrawEnemy(Enemy enemy, QualityTier tier) {
+    bool limbs = tier < QUALITY_SIMPLE;
+    bool details = tier < QUALITY_SIMPLE;
+    bool labels = tier < QUALITY_NO_TEXT;
+
+    if (limbs) {
+        // Ноги для всех врагов
+        DrawLine(enemy.x - 5, enemy.y + enemy.radius, enemy.x - 8, enemy.y + enemy.radius + 10, BLACK);
+        DrawLine(enemy.x + 5, enemy.y + enemy.radius, enemy.x + 8, enemy.y + enemy.radius + 10, BLACK);
+
+        // Руки для всех врагов
+        DrawLine(enemy.x - 8, enemy.y, enemy.x - 8 - 12, enemy.y + 3, BLACK);
+        DrawLine(enemy.x + 8, enemy.y, enemy.x + 8 + 12, enemy.y + 3, BLACK);
+    }
+
+    // Основное тело
+    DrawCircle(enemy.x, enemy.y, enemy.radius, enemy.color);
+    if (tier == QUALITY_MINIMAL) {
+        return;
+    }
+    DrawCircleLines(enemy.x, enemy.y, enemy.radius, BLACK);
+
+    if (enemy.isBoss) {
+        Vector2 crownPoints[7] = {
+            {enemy.x - 25, enemy.y - enemy.radius + 5},
+            {enemy.x - 15, enemy.y - enemy.radius - 10},
+            {enemy.x - 5, enemy.y - enemy.radius + 2},
+            {enemy.x, enemy.y - enemy.radius - 15},
+            {enemy.x + 5, enemy.y - enemy.radius + 2},
+            {enemy.x + 15, enemy.y - enemy.radius - 10},
+            {enemy.x + 25, enemy.y - enemy.radius + 5}
+        };
+
+        for (int i = 0; i < 6; i++) {
+            DrawLine(crownPoints[i].x, crownPoints[i].y, crownPoints[i + 1].x, crownPoints[i + 1].y, YELLOW);
+        }
+
+        if (labels) {
+            DrawText("BOSS", enemy.x - 25, enemy.y - enemy.radius - 40, 16, YELLOW);
+        }
+        if (!details) {
+            return;
+        }
+
+        float eyeOffset = enemy.radius * 0.3;
+        DrawCircle(enemy.x - eyeOffset, enemy.y - 10, 6, RED);
+        DrawCircle(enemy.x + eyeOffset, enemy.y - 10, 6, RED);
+        DrawCircle(enemy.x - eyeOffset, enemy.y - 10, 3, BLACK);
+        DrawCircle(enemy.x + eyeOffset, enemy.y - 10, 3, BLACK);
+
+        DrawLine(enemy.x - 10, enemy.y + 10, enemy.x + 10, enemy.y + 10, BLACK);
+        DrawLine(enemy.x - 10, enemy.y + 10, enemy.x - 8, enemy.y + 5, BLACK);
+        DrawLine(enemy.x + 10, enemy.y + 10, enemy.x + 8, enemy.y + 5, BLACK);
+
+    }
+    else if (enemy.isShooter) {
+        if (labels) {
+            DrawText("S", enemy.x - 5, enemy.y - enemy.radius - 15, 14, WHITE);
+        }
+        if (!details) {
+            return;
+        }
+        // Стреляющий враг - с пистолетом
+        DrawRectangle(enemy.x - 15, enemy.y - 5, 10, 5, DARKGRAY);
+
+        float eyeOffset = enemy.radius * 0.4;
+        DrawCircle(enemy.x - eyeOffset, enemy.y - 5, 3, WHITE);
+        DrawCircle(enemy.x + eyeOffset, enemy.y - 5, 3, WHITE);
+        DrawCircle(enemy.x - eyeOffset, enemy.y - 5, 1, BLACK);
+        DrawCircle(enemy.x + eyeOffset, enemy.y - 5, 1, BLACK);
+
+    }
+    else if (enemy.isTank) {
+        if (labels) {
+            DrawText("T", enemy.x - 5, enemy.y - enemy.radius - 15, 14, WHITE);
+        }
+        if (!details) {
+            return;
+        }
+        // Танк - с броней
+        DrawRectangle(enemy.x - enemy.radius, enemy.y - enemy.radius, enemy.radius * 2, 8, DARKGRAY);
+        DrawRectangle(enemy.x - enemy.radius, enemy.y + enemy.radius - 8, enemy.radius * 2, 8, DARKGRAY);
+
+        float eyeOffset = enemy.radius * 0.3;
+        DrawCircle(enemy.x - eyeOffset, enemy.y - 5, 4, WHITE);
+        DrawCircle(enemy.x + eyeOffset, enemy.y - 5, 4, WHITE);
+        DrawCircle(enemy.x - eyeOffset, enemy.y - 5, 2, BLACK);
+        DrawCircle(enemy.x + eyeOffset, enemy.y - 5, 2, BLACK);
+
+    }
+    else if (enemy.isRunner) {
+        // Бегун - маленький и быстрый
+        if (labels) {
+            DrawText("R", enemy.x - 5, enemy.y - enemy.radius - 12, 12, WHITE);
+        }
+        if (!details) {
+            return;
+        }
+
+        float eyeOffset = enemy.radius * 0.5;
+        DrawCircle(enemy.x - eyeOffset, enemy.y - 3, 2, WHITE);
+        DrawCircle(enemy.x + eyeOffset, enemy.y - 3, 2, WHITE);
+        DrawCircle(enemy.x - eyeOffset, enemy.y - 3, 1, BLACK);
+        DrawCircle(enemy.x + eyeOffset, enemy.y - 3, 1, BLACK);
+
+    }
+    else if (enemy.isElite) {
+        Vector2 crownPoints[7] = {
+            {enemy.x - 15, enemy.y - enemy.radius + 5},
+            {enemy.x - 10, enemy.y - enemy.radius - 5},
+            {enemy.x - 5, enemy.y - enemy.radius + 2},
+            {enemy.x, enemy.y - enemy.radius - 8},
+            {enemy.x + 5, enemy.y - enemy.radius + 2},
+            {enemy.x + 10, enemy.y - enemy.radius - 5},
+            {enemy.x + 15, enemy.y - enemy.radius + 5}
+        };
+
+        for (int i = 0; i < 6; i++) {
+            DrawLine(crownPoints[i].x, crownPoints[i].y, crownPoints[i + 1].x, crownPoints[i + 1].y, YELLOW);
+        }
+
+        if (labels) {
+            DrawText("ELITE", enemy.x - 25, enemy.y - enemy.radius - 25, 12, YELLOW);
+        }
+    }
+    else if (details) {
+        float eyeOffset = enemy.radius * 0.4;
+        Color eyeColor = BLACK;
+
+        DrawCircle(enemy.x - enemy.radius + eyeOffset + 2, enemy.y - enemy.radius + eyeOffset + 2, 4, WHITE);
+        DrawCircle(enemy.x + enemy.radius - eyeOffset - 2, enemy.y - enemy.radius + eyeOffset + 2, 4, WHITE);
+
+        DrawCircle(enemy.x - enemy.radius + eyeOffset + 2, enemy.y - enemy.radius + eyeOffset + 2, 2, eyeColor);
+        DrawCircle(enemy.x + enemy.radius - eyeOffset - 2, enemy.y - enemy.radius + eyeOffset + 2, 2, eyeColor);
+
+        float mouthY = enemy.y + eyeOffset;
+        Vector2 mouthPoints[3] = {
+            {enemy.x - 5, mouthY - 2},
+            {enemy.x + 5, mouthY - 2},
+            {enemy.x, mouthY + 3}
+        };
+        DrawTriangle(mouthPoints[0], mouthPoints[1], mouthPoints[2], BLACK);
+    }
+
+    if (!labels) {
+        return;
+    }
+    char healthText[10];
+    sprintf(healthText, "%d", enemy.health);
+    int textWidth = MeasureText(healthText, 16);
+    DrawText(healthText, enemy.x - textWidth / 2, enemy.y - 25, 16, WHITE);
+}
+
+// Смена атаки босса раз в 3 секунды
+void BossNextPattern(Enemy* boss) {
+    boss->attackPattern = (boss->attackPattern + 1) % 3;
+    StartPattern(&boss->pattern, (PatternId)(PATTERN_BOSS_WAVE + boss->attackPattern));
+}
+
+// Залп одной операции EMIT: направления таблицы поворачиваются на угол излучателя
+void EmitPatternBullets(Game* game, Enemy* enemy, const PatternOp* op) {
+    PatternState* state = &enemy->pattern;
+    const Vector2* directions = &game->patterns->directions[op->table];
+    float c = cosf(state->angle);
+    float s = sinf(state->angle);
+    if (enemy->isBoss) {
+        int count = op->count;
+        if (count > MAX_BOSS_BULLETS - game->bossBulletCount) count = MAX_BOSS_BULLETS - game->bossBulletCount;
+        int first = game->bossBulletCount;
+        BossBullet* out = &game->bossBullets[first];
+        for (int i = 0; i < count; i++) {
+            float dx = directions[i].x * c - directions[i].y * s;
+            float dy = directions[i].x * s + directions[i].y * c;
+            out[i] = CreateBossBullet(enemy->x, enemy->y, dx, dy, state->speed, state->accel, game->timers->now);
+        }
+        game->bossBulletCount += count;
+        SlotMapAdopt(&game->bossBulletSlots, game->bossBulletCount);
+        for (int i = 0; i < count; i++) {
+            ScheduleTimer(game->timers, TIMER_BOSS_BULLET_EXPIRE, out[i].motion.despawnTick, SlotMapHandle(&game->bossBulletSlots, first + i));
+        }
+    }
+    else {
+        int count = op->count;
+        if (count > MAX_ENEMY_BULLETS - game->enemyBulletCount) count = MAX_ENEMY_BULLETS - game->enemyBulletCount;
+        int first = game->enemyBulletCount;
+        EnemyBullet* out = &game->enemyBullets[first];
+        for (int i = 0; i < count; i++) {
+            float dx = directions[i].x * c - directions[i].y * s;
+            float dy = directions[i].x * s + directions[i].y * c;
+            out[i] = CreateEnemyBullet(enemy->x, enemy->y, dx, dy, state->speed, state->accel, game->timers->now);
+        }
+        game->enemyBulletCount += count;
+        SlotMapAdopt(&game->enemyBulletSlots, game->enemyBulletCount);
+        for (int i = 0; i < count; i++) {
+            ScheduleTimer(game->timers, TIMER_ENEMY_BULLET_EXPIRE, out[i].motion.despawnTick, SlotMapHandle(&game->enemyBulletSlots, first + i));
+        }
+    }
+}
+
+// Исполняет паттерн врага до ближайшего wait; возвращает задержку до следующего запуска
+int RunBulletPattern(Game* game, int index) {
+    Enemy* enemy = &game->enemies[index];
+    PatternState* state = &enemy->pattern;
+    const BulletPattern* pattern = &game->patterns->patterns[state->pattern];
+    if (pattern->opCount == 0) {
+        return SIM_TICK_RATE;  // Паттерн не скомпилировался - враг молчит
+    }
+
+    for (int step = 0; step < PATTERN_MAX_STEPS; step++) {
+        if (state->pc >= pattern->opCount) {
+            state->pc = 0;
+            state->depth = 0;
+        }
+        const PatternOp* op = &pattern->ops[state->pc++];
+        switch (op->op) {
+        case PATTERN_OP_SPEED:
+            state->speed = op->value;
+            state->accel = op->accel;
+            break;
+
+        case PATTERN_OP_EMIT:
+            EmitPatternBullets(game, enemy, op);
+            break;
+
+        case PATTERN_OP_AIM:
+            state->angle = atan2f(game->player.y - enemy->y, game->player.x - enemy->x);
+            break;
+
+        case PATTERN_OP_ROTATE:
+            state->angle = fmodf(state->angle + op->value, 2 * PI);
+            break;
+
+        case PATTERN_OP_ANGLE:
+            state->angle = op->value;
+            break;
+
+        case PATTERN_OP_WAIT:
+            return op->count;
+
+        case PATTERN_OP_REPEAT:
+            state->loopLeft[state->depth++] = op->count;
+            break;
+
+        case PATTERN_OP_END: {
+            short* left = &state->loopLeft[state->depth - 1];
+            if (*left == 0 || --(*left) > 0) {
+                state->pc = (unsigned char)op->jump;
+            }
+            else {
+                state->depth--;
+            }
+            break;
+        }
+        }
+    }
+    return 1;  // Цикл без wait - продолжим в следующем тике
+}
+
+// Стрельба остановившихся босса и стрелков идёт по таймерам колеса
+// Шаг "действия": движение по последнему решению, каждый тик
+void UpdateEnemy(Enemy* enemy) {
+    if (enemy->isBoss) {
+        if (!enemy->hasStopped && enemy->y >= enemy->stopY) {
+            enemy->hasStopped = true;
+            enemy->dy = 0;
+        }
+
+        if (!enemy->hasStopped) {
+            enemy->x += enemy->dx;
+            enemy->y += enemy->dy;
+        }
+    }
+    else if (enemy->isShooter) {
+        // Стреляющий враг останавливается и стреляет
+        if (!enemy->hasStopped && enemy->y >= enemy->stopY) {
+            enemy->hasStopped = true;
+            enemy->dy = 0;
+        }
+
+        if (!enemy->hasStopped) {
+            enemy->x += enemy->dx;
+            enemy->y += enemy->dy;
+        }
+    }
+    else {
+        // Обычные враги, танки и бегуны идут к игроку
+        enemy->x += enemy->dx;
+        enemy->y += enemy->dy;
+    }
+}
+
+// Враги, которым есть что решать
+bool EnemyThinks(Enemy enemy) {
+    return !enemy.isBoss && !enemy.isShooter;
+}
+
+// Шаг "решения": направление к игроку по полю направлений
+void EnemyThink(Enemy* enemy, Player player, FlowField* flow) {
+    Vector2 direction = SampleFlowField(flow, enemy->x, enemy->y, player);
+    if (direction.x != 0 || direction.y != 0) {
+        enemy->dx = direction.x * enemy->speed;
+        enemy->dy = direction.y * enemy->speed;
+    }
+}
+
+bool IsEnemyOutsideWorld(Enemy enemy) {
+    return enemy.y > WORLD_HEIGHT + enemy.radius;
+}
+
+bool EnemyTakeDamage(Enemy* enemy, int damage) {
+    enemy->health -= damage;
+    return enemy->health <= 0;
+}
+
+// Касание бьёт не чаще раза в ENEMY_CONTACT_COOLDOWN тиков. Только проверка:
+// откат ставит ApplyGameEvents по событию PLAYER_DAMAGED
+bool EnemyCollidesWithPlayer(const Enemy* enemy, Player player, int now) {
+    if (now < enemy->attackReadyTick) {
+        return false;
+    }
+    return SweptCirclesCollide(Vector2{ enemy->prevX, enemy->prevY }, Vector2{ enemy->x, enemy->y },
+        Vector2{ player.prevX, player.prevY }, Vector2{ player.x, player.y }, enemy->radius + player.radius);
+}
+
+// Функции профайлера
+EnemyArchetype GetEnemyArchetype(Enemy enemy) {
+    // Порядок проверок совпадает с CreateEnemy
+    if (enemy.isBoss) return ARCHETYPE_BOSS;
+    if (enemy.isShooter) return ARCHETYPE_SHOOTER;
+    if (enemy.isTank) return ARCHETYPE_TANK;
+    if (enemy.isRunner) return ARCHETYPE_RUNNER;
+    if (enemy.isElite) return ARCHETYPE_ELITE;
+    return ARCHETYPE_REGULAR;
+}
+
+void ResetProfiler(Profiler* profiler) {
+    memset(profiler, 0, sizeof(Profiler));
+}
+
+void AddArchetypeCost(ArchetypeCost* to, ArchetypeCost from) {
+    to->updateTime += from.updateTime;
+    to->collisionTime += from.collisionTime;
+    to->drawTime += from.drawTime;
+    to->thinkTime += from.thinkTime;
+    to->enemyTicks += from.enemyTicks;
+    to->enemyDraws += from.enemyDraws;
+    to->thinks += from.thinks;
+    to->spawned += from.spawned;
+}
+
+// Микросекунды на одного врага за тик
+double CostPerEnemy(double time, long long count) {
+    return count > 0 ? time * 1000000.0 / count : 0.0;
+}
+
+void ProfilerEndTick(Profiler* profiler, double tickTime) {
+    profiler->tickTime += tickTime;
+    profiler->windowTicks++;
+}
+
+void ProfilerEndFrame(Profiler* profiler) {
+    profiler->windowFrames++;
+    if (profiler->windowFrames < PROFILER_WINDOW) {
+        return;
+    }
+
+    for (int a = 0; a < ARCHETYPE_COUNT; a++) {
+        profiler->shown[a] = profiler->current[a];
+        AddArchetypeCost(&profiler->total[a], profiler->current[a]);
+    }
+    profiler->shownTickTime = profiler->tickTime;
+    profiler->shownTicks = profiler->windowTicks;
+    profiler->totalTickTime += profiler->tickTime;
+    profiler->shownAiTime = profiler->aiTime;
+    profiler->totalAiTime += profiler->aiTime;
+    profiler->shownParticleTime = profiler->particleTime;
+    profiler->totalParticleTime += profiler->particleTime;
+    profiler->shownAiDeferred = profiler->aiDeferred;
+    profiler->totalAiDeferred += profiler->aiDeferred;
+    profiler->totalTicks += profiler->windowTicks;
+    profiler->totalFrames += profiler->windowFrames;
+
+    memset(profiler->current, 0, sizeof(profiler->current));
+    profiler->tickTime = 0;
+    profiler->aiTime = 0;
+    profiler->particleTime = 0;
+    profiler->aiDeferred = 0;
+    profiler->windowTicks = 0;
+    profiler->windowFrames = 0;
+}
+
+void DrawProfilerOverlay(Profiler* profiler, double aiBudgetUs, const ParticleSystem* particles) {
+    int x = WIDTH - 330;
+    int y = 100;
+    DrawRectangle(x - 10, y - 10, 330, 112 + ARCHETYPE_COUNT * 18, { 0, 0, 0, 160 });
+
+    char line[100];
+    double tickMs = profiler->shownTicks > 0 ? profiler->shownTickTime * 1000.0 / profiler->shownTicks : 0.0;
+    sprintf(line, "Tick: %.3f ms   (us per enemy)", tickMs);
+    DrawText(line, x, y, 14, WHITE);
+    DrawText("type      n    upd    col   draw", x, y + 18, 14, LIGHTGRAY);
+
+    for (int a = 0; a < ARCHETYPE_COUNT; a++) {
+        ArchetypeCost cost = profiler->shown[a];
+        double avgCount = profiler->shownTicks > 0 ? (double)cost.enemyTicks / profiler->shownTicks : 0.0;
+        sprintf(line, "%-8s %4.1f %6.2f %6.2f %6.2f", archetypeNames[a], avgCount,
+            CostPerEnemy(cost.updateTime, cost.enemyTicks),
+            CostPerEnemy(cost.collisionTime, cost.enemyTicks),
+            CostPerEnemy(cost.drawTime, cost.enemyDraws));
+        DrawText(line, x, y + 36 + a * 18, 14, WHITE);
+    }
+
+    PacingStats* pacing = &profiler->pacing;
+    int py = y + 36 + ARCHETYPE_COUNT * 18;
+    sprintf(line, "Pacing %.0f Hz: err %.0f/%.0f us, missed %d",
+        pacing->targetHz, pacing->frames > 0 ? pacing->sumError / pacing->frames : 0.0,
+        PacingPercentile(pacing, 0.99), pacing->missed);
+    DrawText(line, x, py, 14, WHITE);
+    sprintf(line, "spin margin %.0f us, wake jitter %.0f us", pacing->spinMargin, pacing->wakeJitter);
+    DrawText(line, x, py + 18, 14, LIGHTGRAY);
+    double aiUs = profiler->shownTicks > 0 ? profiler->shownAiTime * 1000000.0 / profiler->shownTicks : 0.0;
+    sprintf(line, "AI %.0f/%.0f us per tick, deferred %lld", aiUs, aiBudgetUs, profiler->shownAiDeferred);
+    DrawText(line, x, py + 36, 14, WHITE);
+    double particleUs = profiler->shownParticleTime * 1000000.0 / PROFILER_WINDOW;
+    sprintf(line, "Particles %d/%d, %.0f us per frame", particles->count, particles->budget, particleUs);
+    DrawText(line, x, py + 54, 14, WHITE);
+}
+
+// Функции замера задержки ввода
+void ResetLatencyTracker(LatencyTracker* tracker) {
+    bool enabled = tracker->enabled;
+    memset(tracker, 0, sizeof(LatencyTracker));
+    tracker->enabled = enabled;
+}
+
+void AddLatencySample(LatencyHistogram* histogram, double seconds) {
+    double ms = seconds * 1000.0;
+    int bucket = (int)(ms / LATENCY_BUCKET_MS);
+    if (bucket < 0) bucket = 0;
+    if (bucket > LATENCY_BUCKETS) bucket = LATENCY_BUCKETS;
+    histogram->buckets[bucket]++;
+    histogram->count++;
+    histogram->sum += ms;
+    if (ms > histogram->max) histogram->max = ms;
+}
+
+// Верхняя граница корзины, в которую попадает перцентиль, мс
+double LatencyPercentile(LatencyHistogram* histogram, double percentile) {
+    if (histogram->count == 0) {
+        return 0.0;
+    }
+    int target = (int)ceil(histogram->count * percentile);
+    int seen = 0;
+    for (int b = 0; b <= LATENCY_BUCKETS; b++) {
+        seen += histogram->buckets[b];
+        if (seen >= target) {
+            double upper = (b + 1) * LATENCY_BUCKET_MS;
+            return (b < LATENCY_BUCKETS && upper < histogram->max) ? upper : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+// Событие замечено при опросе ввода в момент sampleTime
+void LatencySample(LatencyTracker* tracker, InputEventType type, double sampleTime) {
+    if (!tracker->enabled || tracker->pendingCount >= LATENCY_MAX_PENDING) {
+        return;
+    }
+    LatencyEvent* event = &tracker->pending[tracker->pendingCount];
+    event->type = type;
+    event->sampleTime = sampleTime;
+    event->consumeTime = 0;
+    event->consumed = false;
+    tracker->pendingCount++;
+}
+
+// Тик отработал самое старое ожидающее событие этого типа
+void LatencyConsume(LatencyTracker* tracker, InputEventType type) {
+    for (int i = 0; i < tracker->pendingCount; i++) {
+        LatencyEvent* event = &tracker->pending[i];
+        if (event->type == type && !event->consumed) {
+            event->consumed = true;
+            event->consumeTime = GetTime();
+            return;
+        }
+    }
+}
+
+// Кадр с результатом отдан на показ (вызывается перед EndDrawing)
+void LatencyPresent(LatencyTracker* tracker) {
+    double now = GetTime();
+    for (int i = 0; i < tracker->pendingCount; i++) {
+        LatencyEvent event = tracker->pending[i];
+        bool done = event.consumed;
+        if (done) {
+            AddLatencySample(&tracker->sampleToSim, event.consumeTime - event.sampleTime);
+            AddLatencySample(&tracker->simToPresent, now - event.consumeTime);
+            AddLatencySample(&tracker->total, now - event.sampleTime);
+        }
+        if (done || now - event.sampleTime > LATENCY_TIMEOUT) {
+            for (int j = i; j < tracker->pendingCount - 1; j++) {
+                tracker->pending[j] = tracker->pending[j + 1];
+            }
+            tracker->pendingCount--;
+            i--;
+        }
+    }
+}
+
+// Под колонкой HUD слева: счёт, уровень, враги, ступень качества
+void DrawLatencyOverlay(LatencyTracker* tracker) {
+    int x = 10;
+    int y = 135;
+    DrawRectangle(x - 5, y - 5, 300, 82, { 0, 0, 0, 160 });
+
+    char line[100];
+    sprintf(line, "Input latency, ms (n=%d)", tracker->total.count);
+    DrawText(line, x, y, 14, WHITE);
+    DrawText("stage          p50   p95   p99   max", x, y + 18, 14, LIGHTGRAY);
+
+    const char* names[3] = { "input->tick", "tick->present", "total" };
+    LatencyHistogram* histograms[3] = { &tracker->sampleToSim, &tracker->simToPresent, &tracker->total };
+    for (int h = 0; h < 3; h++) {
+        sprintf(line, "%-13s %5.1f %5.1f %5.1f %5.1f", names[h],
+            LatencyPercentile(histograms[h], 0.50), LatencyPercentile(histograms[h], 0.95),
+            LatencyPercentile(histograms[h], 0.99), histograms[h]->max);
+        DrawText(line, x, y + 36 + h * 14, 14, WHITE);
+    }
+}
+
+void WriteLatencyJson(FILE* file, const char* name, LatencyHistogram* histogram, bool last) {
+    fprintf(file, "    \"%s\": { \"count\": %d, \"mean_ms\": %.3f, \"p50_ms\": %.3f, \"p95_ms\": %.3f, \"p99_ms\": %.3f, \"max_ms\": %.3f }%s\n",
+        name, histogram->count, histogram->count > 0 ? histogram->sum / histogram->count : 0.0,
+        LatencyPercentile(histogram, 0.50), LatencyPercentile(histogram, 0.95),
+        LatencyPercentile(histogram, 0.99), histogram->max, last ? "" : ",");
+}
+
+// Функции звука
+const AudioCue audioCues[GAME_EVENT_TYPE_COUNT] = {
+    { SOUND_HIT, 2, 0, 0.4f },          // hit
+    { SOUND_KILL, 3, 0, 0.7f },         // kill
+    { SOUND_PLAYER_HIT, 1, 15, 1.0f },  // player_damaged
+    { SOUND_BONUS, 1, 0, 0.8f },        // bonus_collected
+    { SOUND_BOSS, 1, 0, 1.0f },         // boss_defeated
+    { SOUND_LEVEL, 1, 0, 0.8f },        // level_complete
+    { SOUND_BOSS, 1, 0, 0.8f }          // boss_spawned
+};
+
+// Звуки синтезируются один раз при запуске, колбэк только читает банк
+void SynthesizeSounds(AudioMixer* mixer) {
+    const float durations[SOUND_COUNT] = { 0.04f, 0.12f, 0.25f, 0.3f, 0.8f, 0.6f };
+    unsigned int seed = 777;
+    int offset = 0;
+    for (int sound = 0; sound < SOUND_COUNT; sound++) {
+        int length = (int)(durations[sound] * AUDIO_SAMPLE_RATE);
+        mixer->clips[sound].offset = offset;
+        mixer->clips[sound].length = length;
+        for (int i = 0; i < length; i++) {
+            float t = (float)i / AUDIO_SAMPLE_RATE;
+            float progress = (float)i / length;
+            seed = seed * 1664525u + 1013904223u;
+            float noise = (seed >> 8) * (2.0f / 16777216.0f) - 1.0f;
+            float value = 0;
+            switch (sound) {
+            case SOUND_HIT:
+                value = noise * expf(-progress * 6);
+                break;
+            case SOUND_KILL: {
+                // Квадрат, падающий с 880 до 220 Гц
+                float phase = (880 * t - 330 * t * progress);
+                value = (phase - floorf(phase) < 0.5f ? 0.5f : -0.5f) * (1 - progress);
+                break;
+            }
+            case SOUND_PLAYER_HIT: {
+                float phase = 110 * t;
+                value = (2 * (phase - floorf(phase)) - 1) * 0.6f * (1 - progress);
+                break;
+            }
+            case SOUND_BONUS: {
+                const float notes[3] = { 660, 880, 1320 };
+                value = sinf(2 * PI * notes[(int)(progress * 3)] * t) * 0.5f * (1 - progress * 0.5f);
+                break;
+            }
+            case SOUND_BOSS:
+                value = (sinf(2 * PI * 55 * t) * 0.7f + noise * 0.2f) * (1 - progress);
+                break;
+            case SOUND_LEVEL:
+                value = (sinf(2 * PI * 440 * t) + sinf(2 * PI * 554 * t) + sinf(2 * PI * 659 * t)) * 0.25f * (1 - progress);
+                break;
+            }
+            mixer->pcm[offset + i] = value;
+        }
+        offset += length;
+    }
+}
+
+// Часы звука: GetTime принадлежит окну raylib и в колбэке не вызывается,
+// steady_clock безопасен из любого потока. Обе стороны кольца берут время
+// отсюда, поэтому задержку команды можно вычитать.
+double AudioClock() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Только из потока симуляции; false - кольцо полно, команда теряется
+bool PushAudioCommand(AudioCommandRing* ring, const AudioCommand* command) {
+    unsigned int head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) >= AUDIO_RING_SIZE) {
+        return false;
+    }
+    ring->commands[head & (AUDIO_RING_SIZE - 1)] = *command;
+    ring->head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+// Только из колбэка
+bool PopAudioCommand(AudioCommandRing* ring, AudioCommand* command) {
+    unsigned int tail = ring->tail.load(std::memory_order_relaxed);
+    if (tail == ring->head.load(std::memory_order_acquire)) {
+        return false;
+    }
+    *command = ring->commands[tail & (AUDIO_RING_SIZE - 1)];
+    ring->tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+// Свободный голос или самый старый, если свободных нет
+void StartVoice(AudioMixer* mixer, const AudioCommand* command) {
+    AudioVoice* voice = &mixer->voices[0];
+    for (int v = 0; v < AUDIO_MAX_VOICES; v++) {
+        if (!mixer->voices[v].active) {
+            voice = &mixer->voices[v];
+            break;
+        }
+        if (mixer->voices[v].serial < voice->serial) {
+            voice = &mixer->voices[v];
+        }
+    }
+    if (voice->active) {
+        mixer->voicesStolen++;
+    }
+    // Равная мощность по каналам
+    float angle = command->pan * PI * 0.5f;
+    voice->active = true;
+    voice->sound = command->sound;
+    voice->position = 0;
+    voice->left = cosf(angle) * command->gain;
+    voice->right = sinf(angle) * command->gain;
+    voice->serial = mixer->serial++;
+    mixer->voicesStarted++;
+}
+
+// Колбэк реального времени: без блокировок, выделений памяти и журнала
+void MixAudio(AudioMixer* mixer, float* out, unsigned int frames) {
+    double start = AudioClock();
+    if (mixer->lastCallback > 0 && start - mixer->lastCallback > AUDIO_LATE_FACTOR * frames / AUDIO_SAMPLE_RATE) {
+        mixer->underruns++;
+    }
+    mixer->lastCallback = start;
+    mixer->callbacks++;
+
+    AudioCommand command;
+    while (PopAudioCommand(&mixer->ring, &command)) {
+        AddLatencySample(&mixer->latency, start - command.time);
+        StartVoice(mixer, &command);
+    }
+
+    memset(out, 0, frames * 2 * sizeof(float));
+    for (int v = 0; v < AUDIO_MAX_VOICES; v++) {
+        AudioVoice* voice = &mixer->voices[v];
+        if (!voice->active) {
+            continue;
+        }
+        AudioClip clip = mixer->clips[voice->sound];
+        const float* pcm = &mixer->pcm[clip.offset + voice->position];
+        int count = clip.length - voice->position;
+        if (count > (int)frames) {
+            count = (int)frames;
+        }
+        for (int f = 0; f < count; f++) {
+            out[2 * f] += pcm[f] * voice->left;
+            out[2 * f + 1] += pcm[f] * voice->right;
+        }
+        voice->position += count;
+        voice->active = voice->position < clip.length;
+    }
+    for (unsigned int i = 0; i < frames * 2; i++) {
+        float value = out[i] * AUDIO_MASTER_GAIN;
+        out[i] = value > 1.0f ? 1.0f : (value < -1.0f ? -1.0f : value);
+    }
+    mixer->mixTime += AudioClock() - start;
+}
+
+// У колбэка raylib нет пользовательского указателя
+AudioMixer* activeMixer = NULL;
+
+void AudioStreamCallback(void* buffer, unsigned int frames) {
+    MixAudio(activeMixer, (float*)buffer, frames);
+}
+
+// Пустое устройство: зовёт смешивание с периодом буфера и выбрасывает звук
+void NullAudioDeviceMain(AudioMixer* mixer) {
+    float buffer[AUDIO_BUFFER_FRAMES * 2];
+    double period = (double)AUDIO_BUFFER_FRAMES / AUDIO_SAMPLE_RATE;
+    double deadline = AudioClock() + period;
+    while (!mixer->quit.load(std::memory_order_acquire)) {
+        MixAudio(mixer, buffer, AUDIO_BUFFER_FRAMES);
+        double wait = deadline - AudioClock();
+        if (wait > 0) {
+            std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+        }
+        deadline += period;
+    }
+}
+
+void StartAudio(AudioMixer* mixer, bool nullDevice) {
+    SynthesizeSounds(mixer);
+    mixer->ring.head.store(0);
+    mixer->ring.tail.store(0);
+    memset(mixer->voices, 0, sizeof(mixer->voices));
+    memset(&mixer->latency, 0, sizeof(mixer->latency));
+    for (int t = 0; t < GAME_EVENT_TYPE_COUNT; t++) {
+        mixer->lastTick[t] = -1000000;
+    }
+    mixer->serial = 0;
+    mixer->callbacks = mixer->underruns = mixer->voicesStarted = mixer->voicesStolen = 0;
+    mixer->commands = mixer->throttled = mixer->dropped = 0;
+    mixer->mixTime = 0;
+    mixer->lastCallback = 0;
+    mixer->quit.store(false);
+
+    if (!nullDevice) {
+        InitAudioDevice();
+        nullDevice = !IsAudioDeviceReady();
+        if (nullDevice) {
+            LOG("audio device unavailable, using null device");
+        }
+    }
+    mixer->nullDevice = nullDevice;
+    if (nullDevice) {
+        mixer->nullThread = std::thread(NullAudioDeviceMain, mixer);
+        return;
+    }
+    activeMixer = mixer;
+    SetAudioStreamBufferSizeDefault(AUDIO_BUFFER_FRAMES);
+    mixer->stream = LoadAudioStream(AUDIO_SAMPLE_RATE, 32, 2);
+    SetAudioStreamCallback(mixer->stream, AudioStreamCallback);
+    PlayAudioStream(mixer->stream);
+}
+
+// После остановки счётчики колбэка можно читать из главного потока
+void StopAudio(AudioMixer* mixer) {
+    if (mixer->nullDevice) {
+        mixer->quit.store(true, std::memory_order_release);
+        if (mixer->nullThread.joinable()) {
+            mixer->nullThread.join();
+        }
+        return;
+    }
+    StopAudioStream(mixer->stream);
+    UnloadAudioStream(mixer->stream);
+    CloseAudioDevice();
+    activeMixer = NULL;
+}
+
+// События тика в звуковые команды; лимиты режут очереди вроде сотни
+// попаданий за тик до пары голосов
+void QueueGameSounds(Game* game) {
+    AudioMixer* mixer = game->audio;
+    if (mixer == NULL) {
+        return;
+    }
+    int played[GAME_EVENT_TYPE_COUNT] = { 0 };
+    double now = AudioClock();
+    for (int e = 0; e < game->events.count; e++) {
+        GameEvent* event = &game->events.events[e];
+        AudioCue cue = audioCues[event->type];
+        // Лазер задевает врагов каждый тик - его попадания не звучат
+        if (cue.sound < 0 || (event->type == GAME_EVENT_HIT && event->source == HIT_SOURCE_LASER)) {
+            continue;
+        }
+        if (played[event->type] >= cue.perTick || game->tick - mixer->lastTick[event->type] < cue.cooldown) {
+            mixer->throttled++;
+            continue;
+        }
+        AudioCommand command;
+        command.sound = (unsigned char)cue.sound;
+        command.gain = cue.gain;
+        float screenX = event->x - game->view.x;
+        command.pan = screenX <= 0 ? 0.0f : (screenX >= WIDTH ? 1.0f : screenX / WIDTH);
+        if (event->type == GAME_EVENT_LEVEL_COMPLETE || event->type == GAME_EVENT_BOSS_DEFEATED) {
+            command.pan = 0.5f;
+        }
+        command.time = now;
+        if (!PushAudioCommand(&mixer->ring, &command)) {
+            mixer->dropped++;
+            continue;
+        }
+        played[event->type]++;
+        if (played[event->type] == 1) {
+            mixer->lastTick[event->type] = game->tick;
+        }
+        mixer->commands++;
+    }
+}
+
+void HashBytes(unsigned long long* hash, const void* data, size_t size) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++) {
+        *hash = (*hash ^ bytes[i]) * 1099511628211ULL;
+    }
+}
+
+// FNV-1a по игровому состоянию: для сверки прогонов с одним сидом
+unsigned long long GameStateHash(Game* game) {
+    unsigned long long hash = 14695981039346656037ULL;
+    HashBytes(&hash, &game->score, sizeof(game->score));
+    HashBytes(&hash, &game->level, sizeof(game->level));
+    HashBytes(&hash, &game->enemiesDefeated, sizeof(game->enemiesDefeated));
+    HashBytes(&hash, &game->player.x, sizeof(float) * 2);
+    HashBytes(&hash, &game->player.health, sizeof(game->player.health));
+    for (int i = 0; i < game->enemyCount; i++) {
+        HashBytes(&hash, &game->enemies[i].x, sizeof(float) * 2);
+        HashBytes(&hash, &game->enemies[i].health, sizeof(int));
+    }
+    for (int i = 0; i < game->bulletCount; i++) {
+        HashBytes(&hash, &game->bullets[i].x, sizeof(float) * 2);
+    }
+    for (int i = 0; i < game->bossBulletCount; i++) {
+        HashBytes(&hash, &game->bossBullets[i].motion, sizeof(Projectile));
+    }
+    for (int i = 0; i < game->enemyBulletCount; i++) {
+        HashBytes(&hash, &game->enemyBullets[i].motion, sizeof(Projectile));
+    }
+    for (int i = 0; i < game->knifeCount; i++) {
+        HashBytes(&hash, &game->knives[i].x, sizeof(float) * 2);
+    }
+    for (int i = 0; i < game->bonusCount; i++) {
+        HashBytes(&hash, &game->bonuses[i].x, sizeof(float) * 2);
+    }
+    return hash;
+}
+
+bool WriteBenchmarkJson(Game* game, const char* path) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        return false;
+    }
+    Profiler* profiler = &game->profiler;
+
+    // Недописанное окно тоже учитываем
+    ArchetypeCost total[ARCHETYPE_COUNT];
+    double enemyTime = 0;
+    for (int a = 0; a < ARCHETYPE_COUNT; a++) {
+        total[a] = profiler->total[a];
+        AddArchetypeCost(&total[a], profiler->current[a]);
+        enemyTime += total[a].updateTime + total[a].collisionTime + total[a].drawTime;
+    }
+    long long frames = profiler->totalFrames + profiler->windowFrames;
+    long long ticks = profiler->totalTicks + profiler->windowTicks;
+    double tickTime = profiler->totalTickTime + profiler->tickTime;
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"frames\": %lld,\n", frames);
+    fprintf(file, "  \"ticks\": %lld,\n", ticks);
+    fprintf(file, "  \"state_hash\": \"%016llx\",\n", GameStateHash(game));
+    fprintf(file, "  \"tick_ms_avg\": %.4f,\n", ticks > 0 ? tickTime * 1000.0 / ticks : 0.0);
+    fprintf(file, "  \"archetypes\": {\n");
+    for (int a = 0; a < ARCHETYPE_COUNT; a++) {
+        ArchetypeCost cost = total[a];
+        double time = cost.updateTime + cost.collisionTime + cost.drawTime;
+        fprintf(file, "    \"%s\": {\n", archetypeNames[a]);
+        fprintf(file, "      \"spawned\": %d,\n", cost.spawned);
+        fprintf(file, "      \"enemy_ticks\": %lld,\n", cost.enemyTicks);
+        fprintf(file, "      \"update_us_per_enemy\": %.4f,\n", CostPerEnemy(cost.updateTime, cost.enemyTicks));
+        fprintf(file, "      \"collision_us_per_enemy\": %.4f,\n", CostPerEnemy(cost.collisionTime, cost.enemyTicks));
+        fprintf(file, "      \"draw_us_per_enemy\": %.4f,\n", CostPerEnemy(cost.drawTime, cost.enemyDraws));
+        fprintf(file, "      \"tick_us_per_enemy\": %.4f,\n", CostPerEnemy(cost.updateTime + cost.collisionTime, cost.enemyTicks));
+        fprintf(file, "      \"thinks\": %lld,\n", cost.thinks);
+        fprintf(file, "      \"think_us_per_decision\": %.4f,\n", CostPerEnemy(cost.thinkTime, cost.thinks));
+        fprintf(file, "      \"cost_share\": %.4f\n", enemyTime > 0 ? time / enemyTime : 0.0);
+        fprintf(file, "    }%s\n", (a < ARCHETYPE_COUNT - 1) ? "," : "");
+    }
+    fprintf(file, "  },\n");
+    PacingStats* pacing = &profiler->pacing;
+    fprintf(file, "  \"pacing\": { \"target_hz\": %.1f, \"frames\": %d, \"missed\": %d, \"mean_error_us\": %.1f, \"p50_error_us\": %.1f, \"p99_error_us\": %.1f, \"max_error_us\": %.1f, \"spin_ms_per_frame\": %.4f, \"spin_margin_us\": %.1f, \"wake_jitter_us\": %.1f },\n",
+        pacing->targetHz, pacing->frames, pacing->missed,
+        pacing->frames > 0 ? pacing->sumError / pacing->frames : 0.0,
+        PacingPercentile(pacing, 0.50), PacingPercentile(pacing, 0.99), pacing->maxError,
+        pacing->frames > 0 ? pacing->spinTime * 1000.0 / pacing->frames : 0.0,
+        pacing->spinMargin, pacing->wakeJitter);
+    fprintf(file, "  \"latency\": {\n");
+    WriteLatencyJson(file, "input_to_tick", &game->latency.sampleToSim, false);
+    WriteLatencyJson(file, "tick_to_present", &game->latency.simToPresent, false);
+    WriteLatencyJson(file, "total", &game->latency.total, true);
+    fprintf(file, "  },\n");
+    TimerWheel* wheel = game->timers;
+    fprintf(file, "  \"timers\": { \"active\": %d, \"scheduled\": %lld, \"fired\": %lld, \"cascaded\": %lld },\n",
+        wheel->active, wheel->scheduled, wheel->fired, wheel->cascaded);
+    FlowField* flow = game->flow;
+    FlowBench* flowBench = &game->flowBench;
+    fprintf(file, "  \"flow_field\": { \"builds\": %d, \"cells_built\": %lld, \"lookups\": %lld, \"direct\": %lld,\n",
+        flow->builds, flow->cellsBuilt, flow->lookups, flow->direct);
+    fprintf(file, "    \"bench\": { \"enemies\": %d, \"ticks\": %d, \"flow_us_per_tick\": %.3f, \"direct_us_per_tick\": %.3f, \"cells_per_tick\": %.2f, \"max_error\": %.3f } },\n",
+        flowBench->enemies, FLOW_BENCH_TICKS, flowBench->flowUsPerTick, flowBench->directUsPerTick,
+        flowBench->cellsPerTick, flowBench->maxError);
+    double aiTime = profiler->totalAiTime + profiler->aiTime;
+    fprintf(file, "  \"ai\": { \"budget_us\": %.1f, \"time_budget\": %s, \"us_per_tick\": %.4f, \"budget_use\": %.4f, \"deferred\": %lld },\n",
+        game->ai->budgetUs, game->ai->timeBudget ? "true" : "false",
+        ticks > 0 ? aiTime * 1000000.0 / ticks : 0.0,
+        ticks > 0 && game->ai->budgetUs > 0 ? aiTime * 1000000.0 / ticks / game->ai->budgetUs : 0.0,
+        profiler->totalAiDeferred + profiler->aiDeferred);
+    long long neighborTests = 0;
+    for (int w = 0; w <= JOB_MAX_WORKERS; w++) {
+        neighborTests += game->separation->neighborTests[w];
+    }
+    fprintf(file, "  \"separation\": { \"enabled\": %s, \"neighbor_tests\": %lld },\n",
+        game->separation->enabled ? "true" : "false", neighborTests);
+    RaycastBench* raycast = &game->raycastBench;
+    fprintf(file, "  \"raycast\": { \"rays\": %d, \"us_per_ray\": %.4f, \"cells_us_per_ray\": %.4f, \"brute_us_per_ray\": %.4f, \"hits_per_ray\": %.3f, \"mismatches\": %d },\n",
+        raycast->rays, raycast->usPerRay, raycast->cellsUsPerRay, raycast->bruteUsPerRay, raycast->hitsPerRay, raycast->mismatches);
+    QueryBench* queries = &game->queryBench;
+    fprintf(file, "  \"queries\": { \"points\": %d, \"us_per_point\": %.4f, \"brute_us_per_point\": %.4f, \"radius_mismatches\": %d, \"nearest_mismatches\": %d, \"cone_mismatches\": %d },\n",
+        queries->points, queries->usPerPoint, queries->bruteUsPerPoint,
+        queries->radiusMismatches, queries->nearestMismatches, queries->coneMismatches);
+    ParticleSystem* particles = game->particles;
+    ParticleBench* particleBench = &game->particleBench;
+    double particleTime = profiler->totalParticleTime + profiler->particleTime;
+    fprintf(file, "  \"particles\": { \"budget\": %d, \"peak\": %d, \"emitted\": %lld, \"dropped\": %lld, \"us_per_frame\": %.4f,\n",
+        particles->budget, particles->peak, particles->emitted, particles->dropped,
+        frames > 0 ? particleTime * 1000000.0 / frames : 0.0);
+    fprintf(file, "    \"stress\": { \"live_avg\": %.0f, \"update_us\": %.2f, \"draw_us\": %.2f, \"frame_us\": %.2f, \"within_budget\": %s } },\n",
+        particleBench->liveAvg, particleBench->updateUs, particleBench->drawUs, particleBench->frameUs,
+        particleBench->updateUs + particleBench->drawUs <= PARTICLE_FRAME_BUDGET_US ? "true" : "false");
+    long long enemyTicks = profiler->farEnemyTicks + profiler->nearEnemyTicks;
+    fprintf(file, "  \"world\": { \"width\": %d, \"height\": %d, \"max_enemies\": %d, \"culled_draws\": %lld, \"far_enemy_share\": %.3f },\n",
+        WORLD_WIDTH, WORLD_HEIGHT, MAX_ENEMIES, profiler->culledDraws,
+        enemyTicks > 0 ? (double)profiler->farEnemyTicks / enemyTicks : 0.0);
+    Presenter* present = game->present;
+    fprintf(file, "  \"render\": { \"base_scale\": %.2f, \"scale\": %.2f, \"internal\": [%d, %d], \"output\": [%.0f, %.0f], \"filter\": \"%s\", \"resizes\": %d },\n",
+        present->baseScale, present->scale, present->target.texture.width, present->target.texture.height,
+        present->dest.width, present->dest.height, present->integerScale ? "integer" : "bilinear", present->resizes);
+    QualityGovernor* quality = &game->quality;
+    fprintf(file, "  \"quality\": { \"tier\": \"%s\", \"changes\": %d, \"frame_ms_avg\": %.3f, \"budget_ms\": %.3f, \"frames_at_tier\": {",
+        qualityNames[quality->tier], quality->changes, quality->average * 1000.0, quality->budget * 1000.0);
+    for (int t = 0; t < QUALITY_TIER_COUNT; t++) {
+        fprintf(file, "%s \"%s\": %lld", t > 0 ? "," : "", qualityNames[t], quality->framesAtTier[t]);
+    }
+    fprintf(file, " } },\n");
+    AudioMixer* audio = game->audio;
+    fprintf(file, "  \"audio\": { \"device\": \"%s\", \"commands\": %lld, \"throttled\": %lld, \"dropped\": %lld, \"voices_started\": %lld, \"voices_stolen\": %lld,\n",
+        audio->nullDevice ? "null" : "raylib", audio->commands, audio->throttled, audio->dropped, audio->voicesStarted, audio->voicesStolen);
+    fprintf(file, "    \"callbacks\": %lld, \"underruns\": %lld, \"mix_us_per_callback\": %.3f, \"buffer_ms\": %.2f,\n",
+        audio->callbacks, audio->underruns, audio->callbacks > 0 ? audio->mixTime * 1000000.0 / audio->callbacks : 0.0,
+        AUDIO_BUFFER_FRAMES * 1000.0 / AUDIO_SAMPLE_RATE);
+    WriteLatencyJson(file, "latency", &audio->latency, true);
+    fprintf(file, "  },\n");
+    fprintf(file, "  \"event_bus\": {\n");
+    fprintf(file, "    \"published\": %llu,\n", game->bus != NULL ? game->bus->published.load() : 0ULL);
+    fprintf(file, "    \"consumers\": {");
+    for (int c = 0; c < game->consumerCount; c++) {
+        EventBusReader* reader = &game->consumers[c]->reader;
+        fprintf(file, "%s \"%s\": { \"received\": %llu, \"overruns\": %llu }",
+            c > 0 ? "," : "", game->consumers[c]->name, reader->received, reader->overruns);
+    }
+    fprintf(file, " },\n");
+    fprintf(file, "    \"counts\": {");
+    for (int t = 0; t < GAME_EVENT_TYPE_COUNT; t++) {
+        fprintf(file, "%s \"%s\": %lld", t > 0 ? "," : "", gameEventNames[t],
+            game->eventStats != NULL ? game->eventStats->counts[t] : 0LL);
+    }
+    fprintf(file, " }\n");
+    fprintf(file, "  }\n");
+    fprintf(file, "}\n");
+
+    fclose(file);
+    return true;
+}
+
+// Функции игры
+Game CreateGame() {
+    Game game;
+    strcpy(game.state, "menu");
+    game.level = 1;
+    game.maxLevel = 3;
+    game.score = 0;
+    game.enemiesToDefeat = 10;
+    game.enemiesDefeated = 0;
+    game.player = CreatePlayer();
+    game.view = WorldView(game.player.x, game.player.y);
+    game.bulletCount = 0;
+    game.bossBulletCount = 0;
+    game.enemyBulletCount = 0;
+    game.enemyCount = 0;
+    game.bonusCount = 0;
+    game.knifeCount = 0;
+    InitSlotMap(&game.bulletSlots);
+    InitSlotMap(&game.bossBulletSlots);
+    InitSlotMap(&game.enemyBulletSlots);
+    InitSlotMap(&game.enemySlots);
+    InitSlotMap(&game.bonusSlots);
+    InitSlotMap(&game.knifeSlots);
+    game.enemySpawnTimer = TimerHandle{ 0, 0 };
+    game.levelCompleteTimer = 0;
+    game.bonusSpawnTimer = TimerHandle{ 0, 0 };
+    game.invincibleTimer = TimerHandle{ 0, 0 };
+    game.damageBonusTimer = TimerHandle{ 0, 0 };
+    game.laserTimer = TimerHandle{ 0, 0 };
+    game.laser.firing = false;
+    game.laser.hitCount = 0;
+    game.bossSpawned = false;
+    game.bossDefeated = false;
+    game.benchMode = false;
+    game.crowdSize = 0;
+    game.raycastBench = RaycastBench{ 0, 0, 0, 0, 0, 0 };
+    game.queryBench = QueryBench{ 0, 0, 0, 0, 0, 0 };
+    game.particleBench = ParticleBench{ 0, 0, 0, 0 };
+    game.flowBench = FlowBench{ 0, 0, 0, 0, 0 };
+    game.particles = NULL;
+    game.present = NULL;
+    game.tick = 0;
+    game.jobs = NULL;
+    game.collision = NULL;
+    game.timers = NULL;
+    game.bus = NULL;
+    game.consumerCount = 0;
+    game.eventStats = NULL;
+    game.audio = NULL;
+    ResetProfiler(&game.profiler);
+    game.latency.enabled = false;
+    ResetLatencyTracker(&game.latency);
+
+    game.newGameButton = CreateButton(WIDTH / 2, 250, 200, 50, "NEW GAME", BLUE, DARKBLUE);
+    game.continueButton = CreateButton(WIDTH / 2, 320, 200, 50, "CONTINUE", BLUE, DARKBLUE);
+    game.quitButton = CreateButton(WIDTH / 2, 390, 200, 50, "QUIT", BLUE, DARKBLUE);
+
+    return game;
+}
+
+void SpawnEnemy(Game* game) {
+    if (game->enemyCount < MAX_ENEMIES) {
+        // НА 3 УРОВНЕ СПАВНИМ ТОЛЬКО БОССА
+        if (game->level == 3) {
+            if (!game->bossSpawned) {
+                game->enemies[game->enemyCount] = CreateEnemy(3, false, true, false, false, false, game->player, game->view);
+                game->profiler.current[ARCHETYPE_BOSS].spawned++;
+                game->enemyCount++;
+                SlotMapAdopt(&game->enemySlots, game->enemyCount);
+                game->bossSpawned = true;
+
+                Enemy* boss = &game->enemies[game->enemyCount - 1];
+                GameEvent* event = PushGameEvent(game, GAME_EVENT_BOSS_SPAWNED, HIT_SOURCE_NONE,
+                    SlotMapHandle(&game->enemySlots, game->enemyCount - 1), EntityHandle{ 0, 0 }, 0, boss->x, boss->y);
+                event->archetype = ARCHETYPE_BOSS;
+            }
+            return;
+        }
+
+        // Шансы спавна разных типов врагов в зависимости от уровня
+        int spawnType = GetRandomValue(0, 100);
+
+        if (game->level == 1) {
+            // На 1 уровне только обычные враги
+            if (spawnType < 70) {
+                game->enemies[game->enemyCount] = CreateEnemy(1, false, false, false, false, false, game->player, game->view);
+            }
+            else if (spawnType < 85) {
+                game->enemies[game->enemyCount] = CreateEnemy(1, false, false, false, false, true, game->player, game->view); // Бегун
+            }
+            else {
+                game->enemies[game->enemyCount] = CreateEnemy(1, false, false, true, false, false, game->player, game->view); // Стрелок
+            }
+        }
+        else if (game->level == 2) {
+            // На 2 уровне появляются все типы
+            if (spawnType < 40) {
+                game->enemies[game->enemyCount] = CreateEnemy(2, false, false, false, false, false, game->player, game->view);
+            }
+            else if (spawnType < 60) {
+                game->enemies[game->enemyCount] = CreateEnemy(2, false, false, false, false, true, game->player, game->view); // Бегун
+            }
+            else if (spawnType < 75) {
+                game->enemies[game->enemyCount] = CreateEnemy(2, false, false, true, false, false, game->player, game->view); // Стрелок
+            }
+            else if (spawnType < 85) {
+                game->enemies[game->enemyCount] = CreateEnemy(2, false, false, false, true, false, game->player, game->view); // Танк
+            }
+            else if (spawnType < 92) {
+                game->enemies[game->enemyCount] = CreateEnemy(2, true, false, false, false, false, game->player, game->view); // Элитный
+            }
+            else {
+                game->enemies[game->enemyCount] = CreateEnemy(3, false, false, false, false, false, game->player, game->view); // Сильный обычный
+            }
+        }
+
+        game->profiler.current[GetEnemyArchetype(game->enemies[game->enemyCount])].spawned++;
+        game->enemyCount++;
+        SlotMapAdopt(&game->enemySlots, game->enemyCount);
+    }
+}
+
+// Толпа преследователей по всей арене (--crowd N) в начале обычного уровня.
+// Прямо в виде никто не появляется: толпа подходит из-за краёв.
+void SpawnCrowd(Game* game, int count) {
+    for (int n = 0; n < count && game->enemyCount < MAX_ENEMIES; n++) {
+        bool runner = GetRandomValue(0, 100) < 25;
+        Enemy enemy = CreateEnemy(game->level, false, false, false, false, runner, game->player, game->view);
+        do {
+            enemy.x = (float)GetRandomValue(50, WORLD_WIDTH - 50);
+            enemy.y = (float)GetRandomValue(50, WORLD_HEIGHT - 50);
+        } while (IsInView(game->view, enemy.x, enemy.y, enemy.radius));
+        enemy.prevX = enemy.x;
+        enemy.prevY = enemy.y;
+        game->enemies[game->enemyCount] = enemy;
+        game->profiler.current[GetEnemyArchetype(enemy)].spawned++;
+        game->enemyCount++;
+        SlotMapAdopt(&game->enemySlots, game->enemyCount);
+    }
 }
 
-bool BossBulletCollidesWithPlayer(BossBullet bullet, Player player) {
-    float distance = sqrt(pow(bullet.x - player.x, 2) + pow(bullet.y - player.y, 2));
-    return distance < bullet.radius + player.radius;
+void SpawnHatBonus(Game* game, float x, float y) {
+    if (game->bonusCount < MAX_BONUSES) {
+        int roll = GetRandomValue(0, 100);
+        const char* bonusType = roll < 40 ? "damage" : (roll < 75 ? "knife" : "laser");
+        game->bonuses[game->bonusCount] = CreateHatBonus(x, y, bonusType);
+        game->bonusCount++;
+        SlotMapAdopt(&game->bonusSlots, game->bonusCount);
+        ScheduleTimer(game->timers, TIMER_BONUS_EXPIRE, game->timers->now + game->bonuses[game->bonusCount - 1].lifetime,
+            SlotMapHandle(&game->bonusSlots, game->bonusCount - 1));
+    }
 }
 
-bool EnemyBulletCollidesWithPlayer(EnemyBullet bullet, Player player) {
-    float distance = sqrt(pow(bullet.x - player.x, 2) + pow(bullet.y - player.y, 2));
-    return distance < bullet.radius + player.radius;
+int EnemySpawnRate(int level) {
+    int spawnRate = 70 - level * 10;
+    if (spawnRate < 30) spawnRate = 30;
+    return spawnRate;
 }
 
-// Функции для врагов
-Enemy CreateEnemy(int enemyLevel, bool elite, bool boss, bool shooter, bool tank, bool runner, Player player) {
-    Enemy enemy;
-    enemy.level = enemyLevel;
-    enemy.isElite = elite;
-    enemy.isBoss = boss;
-    enemy.isShooter = shooter;
-    enemy.isTank = tank;
-    enemy.isRunner = runner;
-    enemy.attackCooldown = 0;
-    enemy.shootCooldown = 0;
-    enemy.hasStopped = false;
-    enemy.attackPattern = 0;
-    enemy.attackTimer = 0;
+// Таймер появления врагов; на 3 уровне обычных врагов нет
+void ScheduleEnemySpawn(Game* game) {
+    CancelTimer(game->timers, game->enemySpawnTimer);
+    game->enemySpawnTimer = TimerHandle{ 0, 0 };
+    if (game->level < 3) {
+        game->enemySpawnTimer = ScheduleTimer(game->timers, TIMER_ENEMY_SPAWN,
+            game->timers->now + EnemySpawnRate(game->level), EntityHandle{ 0, 0 });
+    }
+}
 
-    if (boss) {
-        enemy.radius = 50;
-        enemy.speed = 1;
-        enemy.color = PURPLE;
-        enemy.health = 200;
-        enemy.damage = 3;
-        enemy.scoreValue = 500;
-        enemy.x = WIDTH / 2;
-        enemy.y = -100;
-        enemy.shootCooldown = 30;
+// Убирает все сущности уровня
+void ClearEntities(Game* game) {
+    game->bulletCount = 0;
+    game->bossBulletCount = 0;
+    game->enemyBulletCount = 0;
+    game->enemyCount = 0;
+    game->bonusCount = 0;
+    game->knifeCount = 0;
+    ClearSlotMap(&game->bulletSlots);
+    ClearSlotMap(&game->bossBulletSlots);
+    ClearSlotMap(&game->enemyBulletSlots);
+    ClearSlotMap(&game->enemySlots);
+    ClearSlotMap(&game->bonusSlots);
+    ClearSlotMap(&game->knifeSlots);
+}
+
+void StartNewGame(Game* game) {
+    strcpy(game->state, "playing");
+    game->level = 1;
+    game->score = 0;
+    game->enemiesDefeated = 0;
+    game->enemiesToDefeat = 10;
+    game->player = CreatePlayer();
+    game->view = WorldView(game->player.x, game->player.y);
+    ClearEntities(game);
+    game->bossSpawned = false;
+    game->bossDefeated = false;
+
+    // Таймеры прошлой игры не нужны
+    ClearTimerWheel(game->timers);
+    game->particles->count = 0;
+    game->invincibleTimer = TimerHandle{ 0, 0 };
+    game->damageBonusTimer = TimerHandle{ 0, 0 };
+    game->laserTimer = TimerHandle{ 0, 0 };
+    game->laser.firing = false;
+    game->laser.hitCount = 0;
+    game->bonusSpawnTimer = ScheduleTimer(game->timers, TIMER_BONUS_SPAWN, game->timers->now + 450, EntityHandle{ 0, 0 });
+    ScheduleEnemySpawn(game);
+    SpawnCrowd(game, game->crowdSize);
+    LOG("new game started");
+}
+
+void StartNextLevel(Game* game) {
+    if (game->level < game->maxLevel) {
+        game->level++;
+        game->enemiesDefeated = 0;
+        ClearEntities(game);
+        game->enemiesToDefeat = (game->level == 3) ? 1 : 15;
+        game->bossSpawned = false;
+        game->bossDefeated = false;
+        ScheduleEnemySpawn(game);
+        if (game->level < 3) {
+            SpawnCrowd(game, game->crowdSize);
+        }
+        LOG("level %d started, %d enemies to defeat", game->level, game->enemiesToDefeat);
     }
-    else if (shooter) {
-        enemy.radius = 18;
-        enemy.speed = 1.5f;
-        enemy.color = { 0, 255, 255, 255 }; // Голубой
-        enemy.health = 15;
-        enemy.damage = 1;
-        enemy.scoreValue = 25;
-        enemy.x = GetRandomValue(enemy.radius, WIDTH - enemy.radius);
-        enemy.y = -enemy.radius;
-        enemy.shootCooldown = 90; // Стреляет раз в 1.5 секунды
+    else {
+        strcpy(game->state, "victory");
     }
-    else if (tank) {
-        enemy.radius = 35;
-        enemy.speed = 0.8f;
-        enemy.color = { 100, 100, 100, 255 }; // Серый
-        enemy.health = 50;
-        enemy.damage = 2;
-        enemy.scoreValue = 40;
-        enemy.x = GetRandomValue(enemy.radius, WIDTH - enemy.radius);
-        enemy.y = -enemy.radius;
+}
+
+// Срабатывание таймера. Таймер сущности, которой уже нет, просто пропадает.
+void FireTimer(Game* game, Timer* timer) {
+    TimerWheel* wheel = game->timers;
+    switch (timer->type) {
+    case TIMER_PLAYER_INVINCIBLE:
+        game->player.invincible = false;
+        break;
+
+    case TIMER_PLAYER_BONUS:
+        game->player.damageMultiplier = 1;
+        break;
+
+    case TIMER_PLAYER_LASER:
+        game->player.hasLaser = false;
+        break;
+
+    case TIMER_SHOOTER_FIRE:
+    case TIMER_BOSS_FIRE: {
+        int index = SlotMapFind(&game->enemySlots, timer->target);
+        if (index < 0) {
+            break;
+        }
+        int cooldown = RunBulletPattern(game, index);
+        ScheduleTimer(wheel, (TimerType)timer->type, wheel->now + cooldown, timer->target);
+        break;
     }
-    else if (runner) {
-        enemy.radius = 12;
-        enemy.speed = 4.0f;
-        enemy.color = { 255, 105, 180, 255 }; // Розовый
-        enemy.health = 10;
-        enemy.damage = 1;
-        enemy.scoreValue = 15;
-        enemy.x = GetRandomValue(enemy.radius, WIDTH - enemy.radius);
-        enemy.y = -enemy.radius;
+
+    case TIMER_BOSS_PATTERN: {
+        int index = SlotMapFind(&game->enemySlots, timer->target);
+        if (index < 0) {
+            break;
+        }
+        BossNextPattern(&game->enemies[index]);
+        ScheduleTimer(wheel, TIMER_BOSS_PATTERN, wheel->now + 180, timer->target);
+        break;
     }
-    else if (elite) {
-        enemy.radius = 30;
-        enemy.speed = 1.5;
-        enemy.color = GOLD;
-        enemy.health = 25;
-        enemy.damage = 2;
-        enemy.scoreValue = 50;
-        enemy.x = GetRandomValue(enemy.radius, WIDTH - enemy.radius);
-        enemy.y = -enemy.radius;
+
+    case TIMER_BONUS_EXPIRE: {
+        int index = SlotMapFind(&game->bonusSlots, timer->target);
+        if (index >= 0) {
+            SlotMapErase(&game->bonusSlots, game->bonuses, sizeof(HatBonus), &game->bonusCount, index);
+        }
+        break;
     }
-    else if (enemyLevel == 1) {
-        enemy.radius = 15;
-        enemy.speed = 2;
-        enemy.color = RED;
-        enemy.health = 15;
-        enemy.damage = 1;
-        enemy.scoreValue = 10;
-        enemy.x = GetRandomValue(enemy.radius, WIDTH - enemy.radius);
-        enemy.y = -enemy.radius;
+
+    case TIMER_BOSS_BULLET_EXPIRE: {
+        int index = SlotMapFind(&game->bossBulletSlots, timer->target);
+        if (index >= 0) {
+            SlotMapErase(&game->bossBulletSlots, game->bossBullets, sizeof(BossBullet), &game->bossBulletCount, index);
+        }
+        break;
     }
-    else if (enemyLevel == 2) {
-        enemy.radius = 20;
-        enemy.speed = 2.5;
-        enemy.color = ORANGE;
-        enemy.health = 20;
-        enemy.damage = 1;
-        enemy.scoreValue = 20;
-        enemy.x = GetRandomValue(enemy.radius, WIDTH - enemy.radius);
-        enemy.y = -enemy.radius;
+
+    case TIMER_ENEMY_BULLET_EXPIRE: {
+        int index = SlotMapFind(&game->enemyBulletSlots, timer->target);
+        if (index >= 0) {
+            SlotMapErase(&game->enemyBulletSlots, game->enemyBullets, sizeof(EnemyBullet), &game->enemyBulletCount, index);
+        }
+        break;
     }
-    else {
-        enemy.radius = 25;
-        enemy.speed = 3;
-        enemy.color = { 139, 0, 0, 255 };
-        enemy.health = 25;
-        enemy.damage = 2;
-        enemy.scoreValue = 30;
-        enemy.x = GetRandomValue(enemy.radius, WIDTH - enemy.radius);
-        enemy.y = -enemy.radius;
+
+    case TIMER_ENEMY_SPAWN:
+        SpawnEnemy(game);
+        game->enemySpawnTimer = ScheduleTimer(wheel, TIMER_ENEMY_SPAWN, wheel->now + EnemySpawnRate(game->level), EntityHandle{ 0, 0 });
+        break;
+
+    case TIMER_BONUS_SPAWN: {
+        // После паузы бонус выпадает с шансом 15% в каждый тик
+        int delay = 1;
+        if (GetRandomValue(0, 100) < 15) {
+            SpawnHatBonus(game, game->view.x + GetRandomValue(50, WIDTH - 50), game->view.y - 50);
+            delay = 450;
+        }
+        game->bonusSpawnTimer = ScheduleTimer(wheel, TIMER_BONUS_SPAWN, wheel->now + delay, EntityHandle{ 0, 0 });
+        break;
     }
+    }
+}
 
-    float dx = player.x - enemy.x;
-    float dy = player.y - enemy.y;
-    float distance = sqrt(dx * dx + dy * dy);
-    if (distance > 0) {
-        enemy.dx = dx / distance * enemy.speed;
-        enemy.dy = dy / distance * enemy.speed;
+// Сдвигает колесо на тик игры и отрабатывает истёкшие таймеры
+void RunTimers(Game* game) {
+    AdvanceTimerWheel(game->timers);
+    Timer timer;
+    while (PopExpiredTimer(game->timers, &timer)) {
+        FireTimer(game, &timer);
     }
-    else {
-        enemy.dx = 0;
-        enemy.dy = enemy.speed;
+}
+
+// Остановившийся босс или стрелок начинает стрелять по таймеру
+void StartEnemyAttacks(Game* game, int index) {
+    Enemy* enemy = &game->enemies[index];
+    TimerWheel* wheel = game->timers;
+    EntityHandle handle = SlotMapHandle(&game->enemySlots, index);
+    if (enemy->isBoss) {
+        ScheduleTimer(wheel, TIMER_BOSS_FIRE, wheel->now + enemy->shootCooldown, handle);
+        ScheduleTimer(wheel, TIMER_BOSS_PATTERN, wheel->now + 180, handle);
+    }
+    else if (enemy->isShooter) {
+        ScheduleTimer(wheel, TIMER_SHOOTER_FIRE, wheel->now + enemy->shootCooldown, handle);
+    }
+}
+
+// Пространственный индекс врагов
+int EnemyIndexBucket(int cellX, int cellY) {
+    return (int)(((unsigned)cellX * 73856093u ^ (unsigned)cellY * 19349663u) & (ENEMY_INDEX_BUCKETS - 1));
+}
+
+// Снимок позиций: после удаления врагов индекс надо собрать заново
+void BuildEnemyIndex(EnemyIndex* index, Enemy enemies[], int enemyCount) {
+    int counts[ENEMY_INDEX_BUCKETS + 1] = { 0 };
+    for (int i = 0; i < enemyCount; i++) {
+        index->cellX[i] = (int)floorf(enemies[i].x / ENEMY_INDEX_CELL);
+        index->cellY[i] = (int)floorf(enemies[i].y / ENEMY_INDEX_CELL);
+        counts[EnemyIndexBucket(index->cellX[i], index->cellY[i]) + 1]++;
+    }
+    for (int b = 0; b < ENEMY_INDEX_BUCKETS; b++) {
+        counts[b + 1] += counts[b];
+    }
+    memcpy(index->bucketStart, counts, sizeof(counts));
+    for (int i = 0; i < enemyCount; i++) {
+        int e = counts[EnemyIndexBucket(index->cellX[i], index->cellY[i])]++;
+        index->entries[e] = i;
+        index->entryX[e] = enemies[i].x;
+        index->entryY[e] = enemies[i].y;
+        index->entryRadius[e] = enemies[i].radius;
+    }
+    index->count = enemyCount;
+    index->builds++;
+}
+
+// Малый сдвиг без удалений (расталкивание): позиции в копии обновляются,
+// клетки остаются прежними. Запросы смотрят на кольцо соседних клеток, и
+// сдвиг на скорость врага из него не выводит.
+void RefreshEnemyIndexPositions(EnemyIndex* index, const Enemy enemies[]) {
+    for (int e = 0; e < index->count; e++) {
+        int i = index->entries[e];
+        index->entryX[e] = enemies[i].x;
+        index->entryY[e] = enemies[i].y;
+    }
+}
+
+// Враги в клетке; в корзину могут попасть и чужие клетки, их отсеиваем
+#define FOR_ENEMIES_IN_CELL(index, cx, cy, j) \
+    for (int e_ = (index)->bucketStart[EnemyIndexBucket(cx, cy)], end_ = (index)->bucketStart[EnemyIndexBucket(cx, cy) + 1], j = 0; \
+        e_ < end_ && ((j = (index)->entries[e_]), true); e_++) \
+        if ((index)->cellX[j] == (cx) && (index)->cellY[j] == (cy))
+
+// Враги, чей круг пересекает круг (x, y, radius). Порядок - по клеткам, затем по индексу.
+int QueryEnemiesInRadius(const EnemyIndex* index, const Enemy enemies[], float x, float y, float radius, int out[], int maxOut) {
+    float reach = radius + ENEMY_INDEX_MAX_RADIUS;
+    int minX = (int)floorf((x - reach) / ENEMY_INDEX_CELL);
+    int maxX = (int)floorf((x + reach) / ENEMY_INDEX_CELL);
+    int minY = (int)floorf((y - reach) / ENEMY_INDEX_CELL);
+    int maxY = (int)floorf((y + reach) / ENEMY_INDEX_CELL);
+    int cx0 = (int)floorf(x / ENEMY_INDEX_CELL);
+    int cy0 = (int)floorf(y / ENEMY_INDEX_CELL);
+    if (minX < cx0 - ENEMY_QUERY_MAX_RINGS) minX = cx0 - ENEMY_QUERY_MAX_RINGS;
+    if (maxX > cx0 + ENEMY_QUERY_MAX_RINGS) maxX = cx0 + ENEMY_QUERY_MAX_RINGS;
+    if (minY < cy0 - ENEMY_QUERY_MAX_RINGS) minY = cy0 - ENEMY_QUERY_MAX_RINGS;
+    if (maxY > cy0 + ENEMY_QUERY_MAX_RINGS) maxY = cy0 + ENEMY_QUERY_MAX_RINGS;
+
+    int count = 0;
+    for (int cy = minY; cy <= maxY; cy++) {
+        for (int cx = minX; cx <= maxX; cx++) {
+            FOR_ENEMIES_IN_CELL(index, cx, cy, j) {
+                float dx = enemies[j].x - x;
+                float dy = enemies[j].y - y;
+                float touch = radius + enemies[j].radius;
+                if (dx * dx + dy * dy < touch * touch) {
+                    if (count >= maxOut) return count;
+                    out[count++] = j;
+                }
+            }
+        }
+    }
+    return count;
+}
+
+// Обход клеток кольцами от клетки точки. После кольца r все необойдённые
+// враги дальше r клеток, так что поиск ближайших можно остановить.
+#define FOR_RING_CELLS(cx0, cy0, r, cx, cy) \
+    for (int cy = (cy0) - (r); cy <= (cy0) + (r); cy++) \
+        for (int cx = (cx0) - (r); cx <= (cx0) + (r); cx += (cy == (cy0) - (r) || cy == (cy0) + (r) || (r) == 0) ? 1 : 2 * (r))
+
+int QueryRings(float maxRadius) {
+    int rings = (int)ceilf(maxRadius / ENEMY_INDEX_CELL);
+    return rings < ENEMY_QUERY_MAX_RINGS ? rings : ENEMY_QUERY_MAX_RINGS;
+}
+
+// До k ближайших к точке врагов в пределах maxRadius, по возрастанию расстояния
+int QueryNearestEnemies(const EnemyIndex* index, const Enemy enemies[], float x, float y, float maxRadius, int k, int out[]) {
+    if (k > ENEMY_QUERY_MAX_K) k = ENEMY_QUERY_MAX_K;
+    float bestSq[ENEMY_QUERY_MAX_K];
+    int count = 0;
+    int cx0 = (int)floorf(x / ENEMY_INDEX_CELL);
+    int cy0 = (int)floorf(y / ENEMY_INDEX_CELL);
+    int rings = QueryRings(maxRadius);
+    for (int r = 0; r <= rings; r++) {
+        FOR_RING_CELLS(cx0, cy0, r, cx, cy) {
+            FOR_ENEMIES_IN_CELL(index, cx, cy, j) {
+                float dx = enemies[j].x - x;
+                float dy = enemies[j].y - y;
+                float distanceSq = dx * dx + dy * dy;
+                if (distanceSq > maxRadius * maxRadius || (count == k && distanceSq >= bestSq[k - 1])) {
+                    continue;
+                }
+                // Вставка в отсортированный список
+                int at = count < k ? count++ : k - 1;
+                while (at > 0 && bestSq[at - 1] > distanceSq) {
+                    bestSq[at] = bestSq[at - 1];
+                    out[at] = out[at - 1];
+                    at--;
+                }
+                bestSq[at] = distanceSq;
+                out[at] = j;
+            }
+        }
+        float ringReach = (float)(r * ENEMY_INDEX_CELL);
+        if (count == k && bestSq[k - 1] <= ringReach * ringReach) {
+            break;
+        }
+    }
+    return count;
+}
+
+// Ближайший враг в конусе вокруг direction (единичный вектор); -1 - никого
+int QueryNearestEnemyInCone(const EnemyIndex* index, const Enemy enemies[], float x, float y, Vector2 direction, float cosHalfAngle, float maxRadius) {
+    int best = -1;
+    float bestSq = maxRadius * maxRadius;
+    int cx0 = (int)floorf(x / ENEMY_INDEX_CELL);
+    int cy0 = (int)floorf(y / ENEMY_INDEX_CELL);
+    int rings = QueryRings(maxRadius);
+    for (int r = 0; r <= rings; r++) {
+        FOR_RING_CELLS(cx0, cy0, r, cx, cy) {
+            FOR_ENEMIES_IN_CELL(index, cx, cy, j) {
+                float dx = enemies[j].x - x;
+                float dy = enemies[j].y - y;
+                float distanceSq = dx * dx + dy * dy;
+                if (distanceSq >= bestSq || distanceSq == 0) {
+                    continue;
+                }
+                // cos угла к направлению без sqrt: знак и квадрат
+                float along = dx * direction.x + dy * direction.y;
+                if (along <= 0 || along * along < cosHalfAngle * cosHalfAngle * distanceSq) {
+                    continue;
+                }
+                best = j;
+                bestSq = distanceSq;
+            }
+        }
+        float ringReach = (float)(r * ENEMY_INDEX_CELL);
+        if (best >= 0 && bestSq <= ringReach * ringReach) {
+            break;
+        }
+    }
+    return best;
+}
+
+// Пересечение луча с кругом: расстояние до входа (0, если начало внутри), -1 - мимо
+float RayCircleDistance(float originX, float originY, Vector2 direction, float length, float x, float y, float radius) {
+    float mx = x - originX;
+    float my = y - originY;
+    float along = mx * direction.x + my * direction.y;
+    float disc = along * along - (mx * mx + my * my - radius * radius);
+    if (disc <= 0) {
+        return -1;
+    }
+    float half = sqrtf(disc);
+    if (along + half < 0 || along - half > length) {
+        return -1;
+    }
+    return along - half > 0 ? along - half : 0;
+}
+
+// Луч против врагов корзины [begin, end) индекса; по 4 круга за раз
+int RaycastEntries(const EnemyIndex* index, int begin, int end, Vector2 origin, Vector2 direction, float length,
+    RayHit out[], int count, int maxOut) {
+    int e = begin;
+#ifdef USE_SSE2
+    __m128 ox = _mm_set1_ps(origin.x), oy = _mm_set1_ps(origin.y);
+    __m128 dx = _mm_set1_ps(direction.x), dy = _mm_set1_ps(direction.y);
+    __m128 zero = _mm_setzero_ps(), len = _mm_set1_ps(length);
+    for (; e + 4 <= end; e += 4) {
+        __m128 mx = _mm_sub_ps(_mm_loadu_ps(&index->entryX[e]), ox);
+        __m128 my = _mm_sub_ps(_mm_loadu_ps(&index->entryY[e]), oy);
+        __m128 r = _mm_loadu_ps(&index->entryRadius[e]);
+        __m128 along = _mm_add_ps(_mm_mul_ps(mx, dx), _mm_mul_ps(my, dy));
+        __m128 c = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(mx, mx), _mm_mul_ps(my, my)), _mm_mul_ps(r, r));
+        __m128 disc = _mm_sub_ps(_mm_mul_ps(along, along), c);
+        __m128 half = _mm_sqrt_ps(_mm_max_ps(disc, zero));
+        __m128 enter = _mm_sub_ps(along, half);
+        __m128 hit = _mm_and_ps(_mm_cmpgt_ps(disc, zero),
+            _mm_and_ps(_mm_cmpge_ps(_mm_add_ps(along, half), zero), _mm_cmple_ps(enter, len)));
+        int mask = _mm_movemask_ps(hit);
+        if (mask == 0) {
+            continue;
+        }
+        alignas(16) float distances[4];
+        _mm_store_ps(distances, _mm_max_ps(enter, zero));
+        for (int lane = 0; lane < 4; lane++) {
+            if ((mask & (1 << lane)) && count < maxOut) {
+                out[count].enemy = index->entries[e + lane];
+                out[count].distance = distances[lane];
+                count++;
+            }
+        }
+    }
+#endif
+    for (; e < end; e++) {
+        float distance = RayCircleDistance(origin.x, origin.y, direction, length, index->entryX[e], index->entryY[e], index->entryRadius[e]);
+        if (distance >= 0 && count < maxOut) {
+            out[count].enemy = index->entries[e];
+            out[count].distance = distance;
+            count++;
+        }
+    }
+    return count;
+}
+
+void SortRayHits(RayHit hits[], int count) {
+    for (int i = 1; i < count; i++) {
+        RayHit hit = hits[i];
+        int j = i;
+        while (j > 0 && hits[j - 1].distance > hit.distance) {
+            hits[j] = hits[j - 1];
+            j--;
+        }
+        hits[j] = hit;
+    }
+}
+
+// Клетки луча обходятся по DDA; центр задетого врага лежит в клетке луча или
+// в соседней (радиус меньше клетки), так что смотрим корзины 3x3 вокруг,
+// каждую один раз. Результат не отсортирован.
+int RaycastEnemyCells(const EnemyIndex* index, Vector2 origin, Vector2 direction, float length, RayHit out[], int maxOut) {
+    unsigned char visited[ENEMY_INDEX_BUCKETS / 8] = { 0 };
+    int count = 0;
+
+    int cx = (int)floorf(origin.x / ENEMY_INDEX_CELL);
+    int cy = (int)floorf(origin.y / ENEMY_INDEX_CELL);
+    int stepX = direction.x > 0 ? 1 : -1;
+    int stepY = direction.y > 0 ? 1 : -1;
+    // Путь вдоль луча до следующей границы клетки и шаг между границами
+    float nextX = direction.x != 0 ? ((cx + (stepX > 0)) * ENEMY_INDEX_CELL - origin.x) / direction.x : 1e9f;
+    float nextY = direction.y != 0 ? ((cy + (stepY > 0)) * ENEMY_INDEX_CELL - origin.y) / direction.y : 1e9f;
+    float deltaX = direction.x != 0 ? ENEMY_INDEX_CELL / fabsf(direction.x) : 1e9f;
+    float deltaY = direction.y != 0 ? ENEMY_INDEX_CELL / fabsf(direction.y) : 1e9f;
+
+    for (int cells = 0; cells < ENEMY_RAY_MAX_CELLS; cells++) {
+        for (int ny = cy - 1; ny <= cy + 1; ny++) {
+            for (int nx = cx - 1; nx <= cx + 1; nx++) {
+                int bucket = EnemyIndexBucket(nx, ny);
+                if (visited[bucket >> 3] & (1 << (bucket & 7))) {
+                    continue;
+                }
+                visited[bucket >> 3] |= (unsigned char)(1 << (bucket & 7));
+                count = RaycastEntries(index, index->bucketStart[bucket], index->bucketStart[bucket + 1],
+                    origin, direction, length, out, count, maxOut);
+            }
+        }
+        if (nextX < nextY) {
+            if (nextX > length) break;
+            cx += stepX;
+            nextX += deltaX;
+        }
+        else {
+            if (nextY > length) break;
+            cy += stepY;
+            nextY += deltaY;
+        }
     }
+    return count;
+}
 
-    return enemy;
+// Все враги на отрезке луча длиной length, по возрастанию расстояния.
+// Массивы индекса идут подряд, поэтому небольшую толпу быстрее пройти
+// целиком, чем обходить клетки.
+int RaycastEnemies(const EnemyIndex* index, Vector2 origin, Vector2 direction, float length, RayHit out[], int maxOut) {
+    int count = index->count <= ENEMY_RAY_SWEEP_LIMIT
+        ? RaycastEntries(index, 0, index->count, origin, direction, length, out, 0, maxOut)
+        : RaycastEnemyCells(index, origin, direction, length, out, maxOut);
+    SortRayHits(out, count);
+    return count;
 }
 
-void DrawEnemy(Enemy enemy) {
-    // Ноги для всех врагов
-    DrawLine(enemy.x - 5, enemy.y + enemy.radius, enemy.x - 8, enemy.y + enemy.radius + 10, BLACK);
-    DrawLine(enemy.x + 5, enemy.y + enemy.radius, enemy.x + 8, enemy.y + enemy.radius + 10, BLACK);
+int BruteRaycast(const Enemy* enemies, int enemyCount, Vector2 origin, Vector2 direction, float length, RayHit out[]) {
+    int count = 0;
+    for (int i = 0; i < enemyCount; i++) {
+        float distance = RayCircleDistance(origin.x, origin.y, direction, length, enemies[i].x, enemies[i].y, enemies[i].radius);
+        if (distance >= 0) {
+            out[count].enemy = i;
+            out[count].distance = distance;
+            count++;
+        }
+    }
+    return count;
+}
 
-    // Руки для всех врагов
-    DrawLine(enemy.x - 8, enemy.y, enemy.x - 8 - 12, enemy.y + 3, BLACK);
-    DrawLine(enemy.x + 8, enemy.y, enemy.x + 8 + 12, enemy.y + 3, BLACK);
+void MeasureRaycast(RaycastBench* bench) {
+    static Enemy crowd[MAX_ENEMIES];
+    static EnemyIndex index;
+    static RayHit fast[MAX_ENEMIES], brute[MAX_ENEMIES];
+    unsigned int seed = 12345;
+    for (int i = 0; i < MAX_ENEMIES; i++) {
+        crowd[i].x = BenchRandom(&seed, WIDTH);
+        crowd[i].y = BenchRandom(&seed, HEIGHT);
+        crowd[i].radius = 10 + BenchRandom(&seed, 20);
+    }
+    BuildEnemyIndex(&index, crowd, MAX_ENEMIES);
 
-    // Основное тело
-    DrawCircle(enemy.x, enemy.y, enemy.radius, enemy.color);
-    DrawCircleLines(enemy.x, enemy.y, enemy.radius, BLACK);
+    Vector2 origins[RAYCAST_BENCH_RAYS], directions[RAYCAST_BENCH_RAYS];
+    for (int r = 0; r < RAYCAST_BENCH_RAYS; r++) {
+        origins[r] = { BenchRandom(&seed, WIDTH), BenchRandom(&seed, HEIGHT) };
+        float angle = BenchRandom(&seed, 2 * PI);
+        directions[r] = { cosf(angle), sinf(angle) };
+    }
 
-    if (enemy.isBoss) {
-        Vector2 crownPoints[7] = {
-            {enemy.x - 25, enemy.y - enemy.radius + 5},
-            {enemy.x - 15, enemy.y - enemy.radius - 10},
-            {enemy.x - 5, enemy.y - enemy.radius + 2},
-            {enemy.x, enemy.y - enemy.radius - 15},
-            {enemy.x + 5, enemy.y - enemy.radius + 2},
-            {enemy.x + 15, enemy.y - enemy.radius - 10},
-            {enemy.x + 25, enemy.y - enemy.radius + 5}
-        };
+    long long hits = 0;
+    double start = GetTime();
+    for (int r = 0; r < RAYCAST_BENCH_RAYS; r++) {
+        hits += RaycastEnemies(&index, origins[r], directions[r], LASER_RANGE, fast, MAX_ENEMIES);
+    }
+    double indexed = GetTime() - start;
 
-        for (int i = 0; i < 6; i++) {
-            DrawLine(crownPoints[i].x, crownPoints[i].y, crownPoints[i + 1].x, crownPoints[i + 1].y, YELLOW);
+    start = GetTime();
+    for (int r = 0; r < RAYCAST_BENCH_RAYS; r++) {
+        RaycastEnemyCells(&index, origins[r], directions[r], LASER_RANGE, fast, MAX_ENEMIES);
+    }
+    double cells = GetTime() - start;
+
+    start = GetTime();
+    for (int r = 0; r < RAYCAST_BENCH_RAYS; r++) {
+        BruteRaycast(crowd, MAX_ENEMIES, origins[r], directions[r], LASER_RANGE, brute);
+    }
+    double bruteTime = GetTime() - start;
+
+    int mismatches = 0;
+    for (int r = 0; r < RAYCAST_BENCH_RAYS; r++) {
+        int count = BruteRaycast(crowd, MAX_ENEMIES, origins[r], directions[r], LASER_RANGE, brute);
+        // Сверяем состав обоих путей, порядок равных расстояний может отличаться
+        for (int pass = 0; pass < 2; pass++) {
+            int found = pass == 0
+                ? RaycastEnemies(&index, origins[r], directions[r], LASER_RANGE, fast, MAX_ENEMIES)
+                : RaycastEnemyCells(&index, origins[r], directions[r], LASER_RANGE, fast, MAX_ENEMIES);
+            bool same = found == count;
+            for (int i = 0; i < count && same; i++) {
+                bool present = false;
+                for (int j = 0; j < found; j++) {
+                    present = present || fast[j].enemy == brute[i].enemy;
+                }
+                same = present;
+            }
+            if (!same) {
+                mismatches++;
+            }
         }
+    }
 
-        DrawText("BOSS", enemy.x - 25, enemy.y - enemy.radius - 40, 16, YELLOW);
+    bench->rays = RAYCAST_BENCH_RAYS;
+    bench->usPerRay = indexed * 1000000.0 / RAYCAST_BENCH_RAYS;
+    bench->cellsUsPerRay = cells * 1000000.0 / RAYCAST_BENCH_RAYS;
+    bench->bruteUsPerRay = bruteTime * 1000000.0 / RAYCAST_BENCH_RAYS;
+    bench->hitsPerRay = (double)hits / RAYCAST_BENCH_RAYS;
+    bench->mismatches = mismatches;
+}
 
-        float eyeOffset = enemy.radius * 0.3;
-        DrawCircle(enemy.x - eyeOffset, enemy.y - 10, 6, RED);
-        DrawCircle(enemy.x + eyeOffset, enemy.y - 10, 6, RED);
-        DrawCircle(enemy.x - eyeOffset, enemy.y - 10, 3, BLACK);
-        DrawCircle(enemy.x + eyeOffset, enemy.y - 10, 3, BLACK);
+// Самонаводящиеся ножи и захват цели
+#define KNIFE_LOCK_RANGE 300.0f
+#define KNIFE_REACQUIRE_COS 0.5f     // Новая цель - в пределах 60 градусов от курса
+#define LOCK_ON_RANGE 500.0f
+#define LOCK_ON_COS 0.985f           // Около 10 градусов от прицела
+
+// Веер ножей делит между собой ближайших к игроку врагов
+void AimPlayerKnives(Game* game, int first) {
+    int nearest[ENEMY_QUERY_MAX_K];
+    int found = QueryNearestEnemies(game->enemyIndex, game->enemies, game->player.x, game->player.y,
+        KNIFE_LOCK_RANGE, game->knifeCount - first, nearest);
+    if (found == 0) {
+        return;
+    }
+    for (int i = first; i < game->knifeCount; i++) {
+        game->knives[i].target = SlotMapHandle(&game->enemySlots, nearest[(i - first) % found]);
+    }
+}
 
-        DrawLine(enemy.x - 10, enemy.y + 10, enemy.x + 10, enemy.y + 10, BLACK);
-        DrawLine(enemy.x - 10, enemy.y + 10, enemy.x - 8, enemy.y + 5, BLACK);
-        DrawLine(enemy.x + 10, enemy.y + 10, enemy.x + 8, enemy.y + 5, BLACK);
+// Нож доворачивает на цель; если цели нет - ищет новую впереди по курсу.
+// Пишет только в сам нож, так что идёт в параллельной фазе.
+void SteerKnife(const Game* game, Knife* knife) {
+    int target = knife->target.generation != 0 ? SlotMapFind(&game->enemySlots, knife->target) : -1;
+    if (target < 0) {
+        Vector2 heading = { cosf(knife->directionAngle), sinf(knife->directionAngle) };
+        target = QueryNearestEnemyInCone(game->enemyIndex, game->enemies, knife->x, knife->y, heading,
+            KNIFE_REACQUIRE_COS, knife->maxDistance - knife->distanceTraveled);
+        if (target < 0) {
+            knife->target = EntityHandle{ 0, 0 };
+            return;
+        }
+        knife->target = SlotMapHandle(&game->enemySlots, target);
+    }
+
+    float desired = atan2f(game->enemies[target].y - knife->y, game->enemies[target].x - knife->x);
+    float turn = remainderf(desired - knife->directionAngle, 2 * PI);
+    if (turn > knife->turnRate) turn = knife->turnRate;
+    if (turn < -knife->turnRate) turn = -knife->turnRate;
+    knife->directionAngle += turn;
+}
 
+// Захват цели: ближайший враг в узком конусе вокруг прицела
+Vector2 LockOnAim(Game* game, Vector2 aim) {
+    float dx = aim.x - game->player.x;
+    float dy = aim.y - game->player.y;
+    float distance = sqrtf(dx * dx + dy * dy);
+    if (distance == 0) {
+        return aim;
     }
-    else if (enemy.isShooter) {
-        // Стреляющий враг - с пистолетом
-        DrawRectangle(enemy.x - 15, enemy.y - 5, 10, 5, DARKGRAY);
-        DrawText("S", enemy.x - 5, enemy.y - enemy.radius - 15, 14, WHITE);
+    int target = QueryNearestEnemyInCone(game->enemyIndex, game->enemies, game->player.x, game->player.y,
+        Vector2{ dx / distance, dy / distance }, LOCK_ON_COS, LOCK_ON_RANGE);
+    return target >= 0 ? Vector2{ game->enemies[target].x, game->enemies[target].y } : aim;
+}
 
-        float eyeOffset = enemy.radius * 0.4;
-        DrawCircle(enemy.x - eyeOffset, enemy.y - 5, 3, WHITE);
-        DrawCircle(enemy.x + eyeOffset, enemy.y - 5, 3, WHITE);
-        DrawCircle(enemy.x - eyeOffset, enemy.y - 5, 1, BLACK);
-        DrawCircle(enemy.x + eyeOffset, enemy.y - 5, 1, BLACK);
+// Перебор для сверки запросов: те же условия, что в QueryEnemiesInRadius,
+// QueryNearestEnemies и QueryNearestEnemyInCone, но без индекса
+int BruteEnemiesInRadius(const Enemy enemies[], int enemyCount, float x, float y, float radius, int out[]) {
+    int count = 0;
+    for (int i = 0; i < enemyCount; i++) {
+        float dx = enemies[i].x - x;
+        float dy = enemies[i].y - y;
+        float touch = radius + enemies[i].radius;
+        if (dx * dx + dy * dy < touch * touch) {
+            out[count++] = i;
+        }
+    }
+    return count;
+}
 
+// Квадраты расстояний до k ближайших по возрастанию
+int BruteNearestDistances(const Enemy enemies[], int enemyCount, float x, float y, float maxRadius, int k, float bestSq[]) {
+    int count = 0;
+    for (int i = 0; i < enemyCount; i++) {
+        float dx = enemies[i].x - x;
+        float dy = enemies[i].y - y;
+        float distanceSq = dx * dx + dy * dy;
+        if (distanceSq > maxRadius * maxRadius || (count == k && distanceSq >= bestSq[k - 1])) {
+            continue;
+        }
+        int at = count < k ? count++ : k - 1;
+        while (at > 0 && bestSq[at - 1] > distanceSq) {
+            bestSq[at] = bestSq[at - 1];
+            at--;
+        }
+        bestSq[at] = distanceSq;
     }
-    else if (enemy.isTank) {
-        // Танк - с броней
-        DrawRectangle(enemy.x - enemy.radius, enemy.y - enemy.radius, enemy.radius * 2, 8, DARKGRAY);
-        DrawRectangle(enemy.x - enemy.radius, enemy.y + enemy.radius - 8, enemy.radius * 2, 8, DARKGRAY);
-        DrawText("T", enemy.x - 5, enemy.y - enemy.radius - 15, 14, WHITE);
+    return count;
+}
 
-        float eyeOffset = enemy.radius * 0.3;
-        DrawCircle(enemy.x - eyeOffset, enemy.y - 5, 4, WHITE);
-        DrawCircle(enemy.x + eyeOffset, enemy.y - 5, 4, WHITE);
-        DrawCircle(enemy.x - eyeOffset, enemy.y - 5, 2, BLACK);
-        DrawCircle(enemy.x + eyeOffset, enemy.y - 5, 2, BLACK);
+int BruteNearestInCone(const Enemy enemies[], int enemyCount, float x, float y, Vector2 direction, float cosHalfAngle, float maxRadius) {
+    int best = -1;
+    float bestSq = maxRadius * maxRadius;
+    for (int i = 0; i < enemyCount; i++) {
+        float dx = enemies[i].x - x;
+        float dy = enemies[i].y - y;
+        float distanceSq = dx * dx + dy * dy;
+        float along = dx * direction.x + dy * direction.y;
+        if (distanceSq >= bestSq || distanceSq == 0 || along <= 0 || along * along < cosHalfAngle * cosHalfAngle * distanceSq) {
+            continue;
+        }
+        best = i;
+        bestSq = distanceSq;
+    }
+    return best;
+}
 
+float EnemyDistanceSq(const Enemy enemies[], int i, float x, float y) {
+    float dx = enemies[i].x - x;
+    float dy = enemies[i].y - y;
+    return dx * dx + dy * dy;
+}
+
+// Запросы с дальностями из игры на синтетической толпе, как у лучей.
+// Равные расстояния индекс и перебор могут выдать разными врагами,
+// поэтому ближайших сверяем по расстояниям, а круг - по составу.
+void MeasureQueries(QueryBench* bench) {
+    static Enemy crowd[MAX_ENEMIES];
+    static EnemyIndex index;
+    static int fast[MAX_ENEMIES], brute[MAX_ENEMIES];
+    unsigned int seed = 54321;
+    for (int i = 0; i < MAX_ENEMIES; i++) {
+        crowd[i].x = BenchRandom(&seed, WIDTH);
+        crowd[i].y = BenchRandom(&seed, HEIGHT);
+        crowd[i].radius = 10 + BenchRandom(&seed, 20);
     }
-    else if (enemy.isRunner) {
-        // Бегун - маленький и быстрый
-        DrawText("R", enemy.x - 5, enemy.y - enemy.radius - 12, 12, WHITE);
+    BuildEnemyIndex(&index, crowd, MAX_ENEMIES);
 
-        float eyeOffset = enemy.radius * 0.5;
-        DrawCircle(enemy.x - eyeOffset, enemy.y - 3, 2, WHITE);
-        DrawCircle(enemy.x + eyeOffset, enemy.y - 3, 2, WHITE);
-        DrawCircle(enemy.x - eyeOffset, enemy.y - 3, 1, BLACK);
-        DrawCircle(enemy.x + eyeOffset, enemy.y - 3, 1, BLACK);
+    static Vector2 points[QUERY_BENCH_POINTS], directions[QUERY_BENCH_POINTS];
+    for (int q = 0; q < QUERY_BENCH_POINTS; q++) {
+        points[q] = { BenchRandom(&seed, WIDTH), BenchRandom(&seed, HEIGHT) };
+        float angle = BenchRandom(&seed, 2 * PI);
+        directions[q] = { cosf(angle), sinf(angle) };
+    }
 
+    int nearest[ENEMY_QUERY_MAX_K];
+    float bestSq[ENEMY_QUERY_MAX_K];
+    double start = GetTime();
+    for (int q = 0; q < QUERY_BENCH_POINTS; q++) {
+        QueryEnemiesInRadius(&index, crowd, points[q].x, points[q].y, ENEMY_INDEX_MAX_RADIUS, fast, MAX_ENEMIES);
+        QueryNearestEnemies(&index, crowd, points[q].x, points[q].y, KNIFE_LOCK_RANGE, ENEMY_QUERY_MAX_K, nearest);
+        QueryNearestEnemyInCone(&index, crowd, points[q].x, points[q].y, directions[q], LOCK_ON_COS, LOCK_ON_RANGE);
     }
-    else if (enemy.isElite) {
-        Vector2 crownPoints[7] = {
-            {enemy.x - 15, enemy.y - enemy.radius + 5},
-            {enemy.x - 10, enemy.y - enemy.radius - 5},
-            {enemy.x - 5, enemy.y - enemy.radius + 2},
-            {enemy.x, enemy.y - enemy.radius - 8},
-            {enemy.x + 5, enemy.y - enemy.radius + 2},
-            {enemy.x + 10, enemy.y - enemy.radius - 5},
-            {enemy.x + 15, enemy.y - enemy.radius + 5}
-        };
+    double indexed = GetTime() - start;
 
-        for (int i = 0; i < 6; i++) {
-            DrawLine(crownPoints[i].x, crownPoints[i].y, crownPoints[i + 1].x, crownPoints[i + 1].y, YELLOW);
+    start = GetTime();
+    for (int q = 0; q < QUERY_BENCH_POINTS; q++) {
+        BruteEnemiesInRadius(crowd, MAX_ENEMIES, points[q].x, points[q].y, ENEMY_INDEX_MAX_RADIUS, brute);
+        BruteNearestDistances(crowd, MAX_ENEMIES, points[q].x, points[q].y, KNIFE_LOCK_RANGE, ENEMY_QUERY_MAX_K, bestSq);
+        BruteNearestInCone(crowd, MAX_ENEMIES, points[q].x, points[q].y, directions[q], LOCK_ON_COS, LOCK_ON_RANGE);
+    }
+    double bruteTime = GetTime() - start;
+
+    bench->radiusMismatches = bench->nearestMismatches = bench->coneMismatches = 0;
+    for (int q = 0; q < QUERY_BENCH_POINTS; q++) {
+        float x = points[q].x;
+        float y = points[q].y;
+        int found = QueryEnemiesInRadius(&index, crowd, x, y, ENEMY_INDEX_MAX_RADIUS, fast, MAX_ENEMIES);
+        int count = BruteEnemiesInRadius(crowd, MAX_ENEMIES, x, y, ENEMY_INDEX_MAX_RADIUS, brute);
+        bool same = found == count;
+        for (int i = 0; i < count && same; i++) {
+            bool present = false;
+            for (int j = 0; j < found; j++) {
+                present = present || fast[j] == brute[i];
+            }
+            same = present;
+        }
+        if (!same) {
+            bench->radiusMismatches++;
+        }
+
+        found = QueryNearestEnemies(&index, crowd, x, y, KNIFE_LOCK_RANGE, ENEMY_QUERY_MAX_K, nearest);
+        count = BruteNearestDistances(crowd, MAX_ENEMIES, x, y, KNIFE_LOCK_RANGE, ENEMY_QUERY_MAX_K, bestSq);
+        same = found == count;
+        for (int i = 0; i < count && same; i++) {
+            same = EnemyDistanceSq(crowd, nearest[i], x, y) == bestSq[i];
+        }
+        if (!same) {
+            bench->nearestMismatches++;
         }
 
-        DrawText("ELITE", enemy.x - 25, enemy.y - enemy.radius - 25, 12, YELLOW);
+        // Конус и с узким захватом цели, и с широким доворотом ножа
+        for (int pass = 0; pass < 2; pass++) {
+            float cosHalfAngle = pass == 0 ? LOCK_ON_COS : KNIFE_REACQUIRE_COS;
+            float range = pass == 0 ? LOCK_ON_RANGE : KNIFE_LOCK_RANGE;
+            int fastBest = QueryNearestEnemyInCone(&index, crowd, x, y, directions[q], cosHalfAngle, range);
+            int bruteBest = BruteNearestInCone(crowd, MAX_ENEMIES, x, y, directions[q], cosHalfAngle, range);
+            if ((fastBest < 0) != (bruteBest < 0) ||
+                (fastBest >= 0 && EnemyDistanceSq(crowd, fastBest, x, y) != EnemyDistanceSq(crowd, bruteBest, x, y))) {
+                bench->coneMismatches++;
+            }
+        }
     }
-    else {
-        float eyeOffset = enemy.radius * 0.4;
-        Color eyeColor = BLACK;
 
-        DrawCircle(enemy.x - enemy.radius + eyeOffset + 2, enemy.y - enemy.radius + eyeOffset + 2, 4, WHITE);
-        DrawCircle(enemy.x + enemy.radius - eyeOffset - 2, enemy.y - enemy.radius + eyeOffset + 2, 4, WHITE);
+    bench->points = QUERY_BENCH_POINTS;
+    bench->usPerPoint = indexed * 1000000.0 / QUERY_BENCH_POINTS;
+    bench->bruteUsPerPoint = bruteTime * 1000000.0 / QUERY_BENCH_POINTS;
+}
 
-        DrawCircle(enemy.x - enemy.radius + eyeOffset + 2, enemy.y - enemy.radius + eyeOffset + 2, 2, eyeColor);
-        DrawCircle(enemy.x + enemy.radius - eyeOffset - 2, enemy.y - enemy.radius + eyeOffset + 2, 2, eyeColor);
+// Фазы UpdateGame для планировщика задач
+void IntegrateBulletsJob(void* data, int begin, int end, int) {
+    Game* game = (Game*)data;
+    for (int i = begin; i < end; i++) {
+        UpdateBullet(&game->bullets[i]);
+    }
+}
 
-        float mouthY = enemy.y + eyeOffset;
-        Vector2 mouthPoints[3] = {
-            {enemy.x - 5, mouthY - 2},
-            {enemy.x + 5, mouthY - 2},
-            {enemy.x, mouthY + 3}
-        };
-        DrawTriangle(mouthPoints[0], mouthPoints[1], mouthPoints[2], BLACK);
+void IntegrateKnivesJob(void* data, int begin, int end, int) {
+    Game* game = (Game*)data;
+    for (int i = begin; i < end; i++) {
+        SteerKnife(game, &game->knives[i]);
+        UpdateKnife(&game->knives[i]);
     }
+}
 
-    char healthText[10];
-    sprintf(healthText, "%d", enemy.health);
-    int textWidth = MeasureText(healthText, 16);
-    DrawText(healthText, enemy.x - textWidth / 2, enemy.y - 25, 16, WHITE);
+void IntegrateBonusesJob(void* data, int begin, int end, int) {
+    Game* game = (Game*)data;
+    for (int i = begin; i < end; i++) {
+        UpdateHatBonus(&game->bonuses[i]);
+    }
+}
+
+// Удаление улетевших с сохранением порядка (одним куском)
+void CompactBulletsJob(void* data, int, int, int) {
+    Game* game = (Game*)data;
+    for (int i = game->bulletCount - 1; i >= 0; i--) {
+        if (IsBulletOutsideWorld(game->bullets[i])) {
+            SlotMapErase(&game->bulletSlots, game->bullets, sizeof(game->bullets[0]), &game->bulletCount, i);
+        }
+    }
 }
 
-void ShooterEnemyAttack(Enemy* shooter, EnemyBullet enemyBullets[], int* enemyBulletCount, Player player) {
-    shooter->shootCooldown--;
-    if (shooter->shootCooldown <= 0) {
-        if (*enemyBulletCount < MAX_ENEMY_BULLETS) {
-            enemyBullets[*enemyBulletCount] = CreateEnemyBullet(shooter->x, shooter->y, player.x, player.y);
-            (*enemyBulletCount)++;
+void CompactKnivesJob(void* data, int, int, int) {
+    Game* game = (Game*)data;
+    for (int i = game->knifeCount - 1; i >= 0; i--) {
+        if (IsKnifeOutsideWorld(game->knives[i])) {
+            SlotMapErase(&game->knifeSlots, game->knives, sizeof(game->knives[0]), &game->knifeCount, i);
         }
-        shooter->shootCooldown = 90; // Стреляет раз в 1.5 секунды
     }
 }
 
-void BossAttackPattern(Enemy* boss, BossBullet bossBullets[], int* bossBulletCount) {
-    boss->attackTimer++;
+// Планировщик ИИ
+void InitAiScheduler(AiScheduler* ai, double budgetUs) {
+    memset(ai, 0, sizeof(AiScheduler));
+    ai->budgetUs = budgetUs;
+    ai->timeBudget = true;
+}
 
-    if (boss->attackTimer >= 180) {
-        boss->attackPattern = (boss->attackPattern + 1) % 3;
-        boss->attackTimer = 0;
+// Чем дальше враг от игрока и экрана, тем реже он думает
+int AiThinkPeriod(Enemy enemy, Player player, Rectangle view) {
+    float dx = enemy.x - player.x;
+    float dy = enemy.y - player.y;
+    if (dx * dx + dy * dy < AI_NEAR_RADIUS * AI_NEAR_RADIUS) {
+        return AI_NEAR_PERIOD;
     }
+    return IsInView(view, enemy.x, enemy.y, enemy.radius) ? AI_SCREEN_PERIOD : AI_OFFSCREEN_PERIOD;
+}
 
-    boss->shootCooldown--;
-    if (boss->shootCooldown <= 0) {
-        switch (boss->attackPattern) {
-        case 0: // Веерная атака
-            for (int i = 0; i < 12; i++) {
-                if (*bossBulletCount < MAX_BOSS_BULLETS) {
-                    float angle = i * 30 * PI / 180.0f;
-                    float dx = cos(angle);
-                    float dy = sin(angle);
-                    bossBullets[*bossBulletCount] = CreateBossBullet(boss->x, boss->y, dx, dy);
-                    (*bossBulletCount)++;
-                }
-            }
-            boss->shootCooldown = 40;
-            break;
+// Ярус 0 - рядом с игроком или просрочил решение на AI_STARVE_PERIODS
+// периодов (так дальние не голодают под постоянной нагрузкой), 1 - на экране,
+// 2 - за экраном. Новый враг ещё не думал и сразу попадает в ярус 0.
+int AiThinkTier(int period, int waited) {
+    if (period == AI_NEAR_PERIOD || waited >= period * AI_STARVE_PERIODS) {
+        return 0;
+    }
+    return period == AI_SCREEN_PERIOD ? 1 : 2;
+}
 
-        case 1: // Спиральная атака
-            for (int i = 0; i < 8; i++) {
-                if (*bossBulletCount < MAX_BOSS_BULLETS) {
-                    float angle = (boss->attackTimer * 10 + i * 45) * PI / 180.0f;
-                    float dx = cos(angle);
-                    float dy = sin(angle);
-                    bossBullets[*bossBulletCount] = CreateBossBullet(boss->x, boss->y, dx, dy);
-                    (*bossBulletCount)++;
-                }
-            }
-            boss->shootCooldown = 20;
-            break;
+// Раздаёт решения врагам, у которых подошёл срок, ярус за ярусом; внутри
+// яруса - по индексу. Кто не уложился в бюджет, ждёт следующего тика и со
+// временем поднимается в ярус 0. Часы читаются раз в AI_BUDGET_CHECK решений,
+// время пачки делится между архетипами по числу решений.
+void RunAiScheduler(Game* game) {
+    AiScheduler* ai = game->ai;
+    int now = game->timers->now;
+    double start = GetTime();
+
+    int count = 0;
+    int tierStart[AI_TIER_COUNT + 1] = { 0 };
+    for (int i = 0; i < game->enemyCount; i++) {
+        Enemy* enemy = &game->enemies[i];
+        if (!EnemyThinks(*enemy)) {
+            continue;
+        }
+        int period = AiThinkPeriod(*enemy, game->player, game->view);
+        int waited = enemy->lastThinkTick < 0 ? AI_OFFSCREEN_PERIOD * 100 : now - enemy->lastThinkTick;
+        if (waited < period) {
+            continue;
+        }
+        ai->candidates[count].index = i;
+        ai->candidates[count].tier = AiThinkTier(period, waited);
+        tierStart[ai->candidates[count].tier + 1]++;
+        count++;
+    }
+    // Раскладка подсчётом вместо сортировки
+    for (int t = 0; t < AI_TIER_COUNT; t++) {
+        tierStart[t + 1] += tierStart[t];
+    }
+    for (int c = 0; c < count; c++) {
+        ai->order[tierStart[ai->candidates[c].tier]++] = ai->candidates[c].index;
+    }
 
-        case 2: // Прицельная атака + веер
-            for (int i = -1; i <= 1; i++) {
-                if (*bossBulletCount < MAX_BOSS_BULLETS) {
-                    float spread = i * 0.2f;
-                    bossBullets[*bossBulletCount] = CreateBossBullet(boss->x, boss->y, 0 + spread, 1);
-                    (*bossBulletCount)++;
-                }
-            }
-            for (int i = 0; i < 8; i++) {
-                if (*bossBulletCount < MAX_BOSS_BULLETS) {
-                    float angle = (i * 45 - 20) * PI / 180.0f;
-                    float dx = cos(angle);
-                    float dy = sin(angle);
-                    bossBullets[*bossBulletCount] = CreateBossBullet(boss->x, boss->y, dx, dy);
-                    (*bossBulletCount)++;
-                }
-            }
-            boss->shootCooldown = 50;
+    int thinks = 0;
+    double budget = ai->budgetUs / 1000000.0;
+    double blockStart = start;
+    int blockThinks[ARCHETYPE_COUNT] = { 0 };
+    int blockCount = 0;
+    while (thinks < count && thinks < AI_MAX_THINKS) {
+        Enemy* enemy = &game->enemies[ai->order[thinks]];
+        EnemyThink(enemy, game->player, game->flow);
+        enemy->lastThinkTick = now;
+        EnemyArchetype archetype = GetEnemyArchetype(*enemy);
+        game->profiler.current[archetype].thinks++;
+        blockThinks[archetype]++;
+        blockCount++;
+        thinks++;
+        if (blockCount < AI_BUDGET_CHECK && thinks < count && thinks < AI_MAX_THINKS) {
+            continue;
+        }
+
+        double blockEnd = GetTime();
+        for (int a = 0; a < ARCHETYPE_COUNT; a++) {
+            game->profiler.current[a].thinkTime += (blockEnd - blockStart) * blockThinks[a] / blockCount;
+            blockThinks[a] = 0;
+        }
+        blockStart = blockEnd;
+        blockCount = 0;
+        // Первая пачка идёт всегда, чтобы очередь двигалась при любом бюджете
+        if (ai->timeBudget && blockEnd - start >= budget) {
             break;
         }
     }
+
+    ai->lastThinks = thinks;
+    ai->lastDeferred = count - thinks;
+    game->profiler.aiDeferred += count - thinks;
+    game->profiler.aiTime += blockStart - start;
 }
 
-void UpdateEnemy(Enemy* enemy, Player player, BossBullet bossBullets[], int* bossBulletCount, EnemyBullet enemyBullets[], int* enemyBulletCount) {
-    if (enemy->isBoss) {
-        if (!enemy->hasStopped && enemy->y >= 100) {
-            enemy->hasStopped = true;
-            enemy->dy = 0;
-        }
+// Расталкивание толпы
+bool IsChasingEnemy(Enemy enemy) {
+    return !enemy.isBoss && !enemy.isShooter;
+}
 
-        if (enemy->hasStopped) {
-            BossAttackPattern(enemy, bossBullets, bossBulletCount);
+// Грубый путь для преследователей далеко за видом: их никто не видит.
+// Раз в ENEMY_FAR_PERIOD тиков (со сдвигом по индексу, чтобы не всех сразу)
+// враг проходит накопленный путь, а расталкивание его пропускает. Поиск
+// столкновений идёт как обычно: отрезок prev -> текущая позиция покрывает
+// и скачок, так что пуля или нож за видом тоже попадают.
+void StepFarEnemies(Game* game) {
+    int far = 0;
+    for (int i = 0; i < game->enemyCount; i++) {
+        Enemy* enemy = &game->enemies[i];
+        enemy->isFar = IsChasingEnemy(*enemy) && !IsInView(game->view, enemy->x, enemy->y, ENEMY_FAR_MARGIN + enemy->radius);
+        if (!enemy->isFar) {
+            continue;
         }
-        else {
-            enemy->x += enemy->dx;
-            enemy->y += enemy->dy;
+        far++;
+        if ((game->tick + i) % ENEMY_FAR_PERIOD == 0) {
+            enemy->x += enemy->dx * ENEMY_FAR_PERIOD;
+            enemy->y += enemy->dy * ENEMY_FAR_PERIOD;
         }
     }
-    else if (enemy->isShooter) {
-        // Стреляющий враг останавливается и стреляет
-        if (!enemy->hasStopped && enemy->y >= 150) {
-            enemy->hasStopped = true;
-            enemy->dy = 0;
-        }
+    game->profiler.farEnemyTicks += far;
+    game->profiler.nearEnemyTicks += game->enemyCount - far;
+}
 
-        if (enemy->hasStopped) {
-            ShooterEnemyAttack(enemy, enemyBullets, enemyBulletCount, player);
+// Толчок от всех соседей, перекрывающихся с врагом. Ограничена только длина
+// суммы: в плотной толпе она иначе выталкивала бы врага на несколько радиусов.
+// Только чтение позиций.
+Vector2 SeparationPush(Game* game, int index, int worker) {
+    SeparationGrid* grid = game->separation;
+    Enemy* enemy = &game->enemies[index];
+    Vector2 push = { 0, 0 };
+    int found[MAX_ENEMIES];
+    int foundCount = QueryEnemiesInRadius(game->enemyIndex, game->enemies, enemy->x, enemy->y, enemy->radius, found, MAX_ENEMIES);
+    for (int f = 0; f < foundCount; f++) {
+        int j = found[f];
+        if (j == index || !IsChasingEnemy(game->enemies[j])) {
+            continue;
+        }
+        grid->neighborTests[worker]++;
+        Enemy* other = &game->enemies[j];
+        float dx = enemy->x - other->x;
+        float dy = enemy->y - other->y;
+        float reach = enemy->radius + other->radius;
+        float distance = sqrtf(dx * dx + dy * dy);
+        if (distance > 0) {
+            push.x += dx / distance * (reach - distance) * 0.5f;
+            push.y += dy / distance * (reach - distance) * 0.5f;
         }
         else {
-            enemy->x += enemy->dx;
-            enemy->y += enemy->dy;
+            // Враги в одной точке расходятся по индексу
+            push.x += (index < j ? -reach : reach) * 0.5f;
         }
     }
-    else {
-        // Обычные враги, танки и бегуны просто двигаются к игроку
-        float dx = player.x - enemy->x;
-        float dy = player.y - enemy->y;
-        float distance = sqrt(dx * dx + dy * dy);
-        if (distance > 0) {
-            enemy->dx = dx / distance * enemy->speed;
-            enemy->dy = dy / distance * enemy->speed;
+    float maxPush = enemy->radius * SEPARATION_MAX_PUSH;
+    float length = sqrtf(push.x * push.x + push.y * push.y);
+    if (length > maxPush) {
+        push.x *= maxPush / length;
+        push.y *= maxPush / length;
+    }
+    return push;
+}
+
+void SeparationPushJob(void* data, int begin, int end, int worker) {
+    Game* game = (Game*)data;
+    SeparationGrid* grid = game->separation;
+    for (int k = begin; k < end; k++) {
+        int i = (grid->sliceBegin + k) % game->enemyCount;
+        // Вдали от вида перекрытия никто не видит - толпу там не расталкиваем
+        Enemy* enemy = &game->enemies[i];
+        bool active = IsChasingEnemy(*enemy) && !enemy->isFar && IsInView(game->view, enemy->x, enemy->y, SEPARATION_ACTIVE_MARGIN);
+        grid->push[i] = active ? SeparationPush(game, i, worker) : Vector2{ 0, 0 };
+    }
+}
+
+// Сдвиг за тик не больше собственной скорости врага, чтобы толпа не дёргалась
+void SeparationApplyJob(void* data, int begin, int end, int) {
+    Game* game = (Game*)data;
+    SeparationGrid* grid = game->separation;
+    for (int k = begin; k < end; k++) {
+        int i = (grid->sliceBegin + k) % game->enemyCount;
+        Enemy* enemy = &game->enemies[i];
+        float px = grid->push[i].x * SEPARATION_STRENGTH;
+        float py = grid->push[i].y * SEPARATION_STRENGTH;
+        float lengthSq = px * px + py * py;
+        if (lengthSq == 0) {
+            continue;
         }
+        if (lengthSq > enemy->speed * enemy->speed) {
+            float scale = enemy->speed / sqrtf(lengthSq);
+            px *= scale;
+            py *= scale;
+        }
+        enemy->x += px;
+        enemy->y += py;
+    }
+}
 
-        enemy->x += enemy->dx;
-        enemy->y += enemy->dy;
+// Расталкивает не больше SEPARATION_SLICE врагов за тик, по кругу.
+// Толчки считаются по позициям до сдвига, так что результат не зависит
+// от числа потоков. Индекс должен быть собран после движения врагов.
+void SeparateEnemies(Game* game) {
+    SeparationGrid* grid = game->separation;
+    if (!grid->enabled || game->enemyCount < 2) {
+        return;
     }
+    if (grid->cursor >= game->enemyCount) grid->cursor = 0;
+    grid->sliceBegin = grid->cursor;
+    grid->sliceCount = game->enemyCount < SEPARATION_SLICE ? game->enemyCount : SEPARATION_SLICE;
+    grid->cursor = (grid->cursor + grid->sliceCount) % game->enemyCount;
+
+    JobGraph separation;
+    InitJobGraph(&separation);
+    int push = AddJobPhase(&separation, "separation_push", SeparationPushJob, game, grid->sliceCount, JOB_PARALLEL_MIN, JOB_CHUNK);
+    AddJobDependency(&separation, AddJobPhase(&separation, "separation_apply", SeparationApplyJob, game, grid->sliceCount, JOB_PARALLEL_MIN, JOB_CHUNK), push);
+    RunJobGraph(game->jobs, &separation);
+    RefreshEnemyIndexPositions(game->enemyIndex, game->enemies);
+}
 
-    if (enemy->attackCooldown > 0) {
-        enemy->attackCooldown--;
+// Поиск столкновений: только чтение состояния, пары пишутся в буфер своего потока
+void PushHitPair(CollisionBuffers* buffers, HitPair* hits, int* count, int capacity, int worker, HitPair pair) {
+    if (*count >= capacity) {
+        buffers->overflowed[worker] = true;
+        return;
     }
+    hits[(*count)++] = pair;
 }
 
-bool IsEnemyOffScreen(Enemy enemy) {
-    return enemy.y > HEIGHT + enemy.radius;
+void DetectBulletHits(Game* game, int begin, int end, int worker, HitPair* hits, int* count, int capacity) {
+    CollisionBuffers* buffers = game->collision;
+    for (int i = begin; i < end; i++) {
+        Enemy* enemy = &game->enemies[i];
+        buffers->tests[worker][GetEnemyArchetype(*enemy)] += game->bulletCount;
+        Vector2 enemyFrom = { enemy->prevX, enemy->prevY };
+        Vector2 enemyTo = { enemy->x, enemy->y };
+        for (int j = 0; j < game->bulletCount; j++) {
+            Bullet* bullet = &game->bullets[j];
+            if (SweptCirclesCollide(Vector2{ bullet->prevX, bullet->prevY }, Vector2{ bullet->x, bullet->y },
+                enemyFrom, enemyTo, bullet->radius + enemy->radius)) {
+                HitPair pair = { i, j };
+                PushHitPair(buffers, hits, count, capacity, worker, pair);
+            }
+        }
+    }
 }
 
-bool EnemyTakeDamage(Enemy* enemy, int damage) {
-    enemy->health -= damage;
-    return enemy->health <= 0;
+void DetectKnifeHits(Game* game, int begin, int end, int worker, HitPair* hits, int* count, int capacity) {
+    CollisionBuffers* buffers = game->collision;
+    for (int i = begin; i < end; i++) {
+        Knife* knife = &game->knives[i];
+        Vector2 knifeFrom = { knife->prevX, knife->prevY };
+        Vector2 knifeTo = { knife->x, knife->y };
+        for (int j = 0; j < game->enemyCount; j++) {
+            Enemy* enemy = &game->enemies[j];
+            buffers->tests[worker][GetEnemyArchetype(*enemy)]++;
+            if (SweptCirclesCollide(knifeFrom, knifeTo, Vector2{ enemy->prevX, enemy->prevY }, Vector2{ enemy->x, enemy->y },
+                knife->radius + enemy->radius)) {
+                HitPair pair = { i, j };
+                PushHitPair(buffers, hits, count, capacity, worker, pair);
+            }
+        }
+    }
+}
+
+void DetectBulletHitsJob(void* data, int begin, int end, int worker) {
+    Game* game = (Game*)data;
+    CollisionBuffers* buffers = game->collision;
+    DetectBulletHits(game, begin, end, worker, buffers->bulletHits[worker], &buffers->bulletHitCount[worker], COLLISION_HITS_PER_WORKER);
+}
+
+void DetectKnifeHitsJob(void* data, int begin, int end, int worker) {
+    Game* game = (Game*)data;
+    CollisionBuffers* buffers = game->collision;
+    DetectKnifeHits(game, begin, end, worker, buffers->knifeHits[worker], &buffers->knifeHitCount[worker], COLLISION_HITS_PER_WORKER);
+}
+
+int CompareHitPairs(const void* a, const void* b) {
+    const HitPair* left = (const HitPair*)a;
+    const HitPair* right = (const HitPair*)b;
+    if (left->first != right->first) return left->first < right->first ? -1 : 1;
+    if (left->second != right->second) return left->second < right->second ? -1 : 1;
+    return 0;
 }
 
-bool EnemyCollidesWithPlayer(Enemy enemy, Player player) {
-    float distance = sqrt(pow(enemy.x - player.x, 2) + pow(enemy.y - player.y, 2));
-    bool collided = distance < enemy.radius + player.radius;
+// Склеивает буферы потоков и сортирует: порядок не зависит от числа потоков
+int MergeHitPairs(CollisionBuffers* buffers, HitPair hits[][COLLISION_HITS_PER_WORKER], int* counts) {
+    int total = 0;
+    for (int w = 0; w <= JOB_MAX_WORKERS; w++) {
+        memcpy(&buffers->merged[total], hits[w], counts[w] * sizeof(HitPair));
+        total += counts[w];
+    }
+    qsort(buffers->merged, total, sizeof(HitPair), CompareHitPairs);
+    return total;
+}
+
+// Попадание во врага с учётом урона, уже набранного в этом тике. Здоровье
+// врага не трогается - его уменьшит шаг применения событий.
+bool EmitEnemyHit(Game* game, int* health, int index, HitSource source, EntityHandle sourceHandle, int damage) {
+    Enemy* enemy = &game->enemies[index];
+    EntityHandle target = SlotMapHandle(&game->enemySlots, index);
+    GameEvent* event = PushGameEvent(game, GAME_EVENT_HIT, source, target, sourceHandle, damage, enemy->x, enemy->y);
+    event->archetype = (unsigned char)GetEnemyArchetype(*enemy);
+
+    health[index] -= damage;
+    if (health[index] > 0) {
+        return false;
+    }
+    event = PushGameEvent(game, GAME_EVENT_KILL, source, target, sourceHandle, enemy->scoreValue, enemy->x, enemy->y);
+    event->archetype = (unsigned char)GetEnemyArchetype(*enemy);
 
-    if (collided && enemy.attackCooldown == 0) {
-        enemy.attackCooldown = 30;
+    // ПРОВЕРКА ПОБЕДЫ НАД БОССОМ
+    if (game->level == 3 && enemy->isBoss) {
+        PushGameEvent(game, GAME_EVENT_BOSS_DEFEATED, source, target, sourceHandle, enemy->scoreValue, enemy->x, enemy->y);
         return true;
     }
     return false;
 }
 
-// Функции игры
-Game CreateGame() {
-    Game game;
-    strcpy(game.state, "menu");
-    game.level = 1;
-    game.maxLevel = 3;
-    game.score = 0;
-    game.enemiesToDefeat = 10;
-    game.enemiesDefeated = 0;
-    game.player = CreatePlayer();
-    game.bulletCount = 0;
-    game.bossBulletCount = 0;
-    game.enemyBulletCount = 0;
-    game.enemyCount = 0;
-    game.bonusCount = 0;
-    game.knifeCount = 0;
-    game.enemySpawnTimer = 0;
-    game.levelCompleteTimer = 0;
-    game.bonusSpawnTimer = 0;
-    game.bossSpawned = false;
-    game.bossDefeated = false;
+// Столкновения пуль и ножей с врагами. Поиск идёт параллельно, а события
+// попаданий и убийств пишутся в фиксированном порядке: враги по индексу берут
+// первую свободную пулю, затем ножи по индексу бьют первого живого врага.
+// Результат совпадает с однопоточным при любом числе потоков.
+void DetectEnemyCollisions(Game* game) {
+    CollisionBuffers* buffers = game->collision;
+    double start = GetTime();
+    memset(buffers->bulletHitCount, 0, sizeof(buffers->bulletHitCount));
+    memset(buffers->knifeHitCount, 0, sizeof(buffers->knifeHitCount));
+    memset(buffers->overflowed, 0, sizeof(buffers->overflowed));
+    memset(buffers->tests, 0, sizeof(buffers->tests));
+
+    JobGraph detection;
+    InitJobGraph(&detection);
+    AddJobPhase(&detection, "detect_bullet_hits", DetectBulletHitsJob, game, game->enemyCount, COLLISION_CHUNK * 2, COLLISION_CHUNK);
+    AddJobPhase(&detection, "detect_knife_hits", DetectKnifeHitsJob, game, game->knifeCount, COLLISION_CHUNK * 2, COLLISION_CHUNK);
+    RunJobGraph(game->jobs, &detection);
+
+    bool overflowed = false;
+    for (int w = 0; w <= JOB_MAX_WORKERS; w++) {
+        overflowed = overflowed || buffers->overflowed[w];
+    }
+
+    int health[MAX_ENEMIES];
+    bool bulletUsed[MAX_BULLETS] = { false };
+    bool knifeUsed[MAX_KNIVES] = { false };
+    bool bossDefeated = false;
+    for (int i = 0; i < game->enemyCount; i++) {
+        health[i] = game->enemies[i].health;
+    }
+
+    // Пули по врагам
+    int hitCount;
+    if (overflowed) {
+        // Буфер потока переполнен - ищем заново одним потоком прямо в общий буфер
+        LOG("collision buffers overflowed at tick %d: %d enemies, %d bullets, %d knives", game->tick,
+            game->enemyCount, game->bulletCount, game->knifeCount);
+        hitCount = 0;
+        DetectBulletHits(game, 0, game->enemyCount, 0, buffers->merged, &hitCount, COLLISION_MERGED_SIZE);
+    }
+    else {
+        hitCount = MergeHitPairs(buffers, buffers->bulletHits, buffers->bulletHitCount);
+    }
+    int h = 0;
+    for (int i = 0; i < game->enemyCount && !bossDefeated; i++) {
+        Enemy* enemy = &game->enemies[i];
+        if (EnemyCollidesWithPlayer(enemy, game->player, game->timers->now)) {
+            PushGameEvent(game, GAME_EVENT_PLAYER_DAMAGED, HIT_SOURCE_ENEMY, EntityHandle{ 0, 0 },
+                SlotMapHandle(&game->enemySlots, i), enemy->damage, enemy->x, enemy->y);
+        }
+
+        for (; h < hitCount && buffers->merged[h].first == i; h++) {
+            int j = buffers->merged[h].second;
+            if (bulletUsed[j]) {
+                continue;
+            }
+            bulletUsed[j] = true;
+            bossDefeated = EmitEnemyHit(game, health, i, HIT_SOURCE_BULLET, SlotMapHandle(&game->bulletSlots, j), game->bullets[j].damage);
+            break;
+        }
+        while (h < hitCount && buffers->merged[h].first == i) {
+            h++;
+        }
+    }
+
+    // Ножи по врагам
+    if (overflowed) {
+        hitCount = 0;
+        DetectKnifeHits(game, 0, game->knifeCount, 0, buffers->merged, &hitCount, COLLISION_MERGED_SIZE);
+    }
+    else {
+        hitCount = MergeHitPairs(buffers, buffers->knifeHits, buffers->knifeHitCount);
+    }
+    for (h = 0; h < hitCount && !bossDefeated; h++) {
+        int i = buffers->merged[h].first;
+        int j = buffers->merged[h].second;
+        if (knifeUsed[i] || health[j] <= 0) {
+            continue;
+        }
+        knifeUsed[i] = true;
+        bossDefeated = EmitEnemyHit(game, health, j, HIT_SOURCE_KNIFE, SlotMapHandle(&game->knifeSlots, i), 3);
+    }
+
+    // Лазер бьёт всех на луче, ближние первыми
+    LaserBeam* laser = &game->laser;
+    laser->hitCount = 0;
+    if (laser->firing) {
+        laser->origin = { game->player.x, game->player.y };
+        float dx = laser->aim.x - laser->origin.x;
+        float dy = laser->aim.y - laser->origin.y;
+        float distance = sqrtf(dx * dx + dy * dy);
+        laser->direction = distance > 0 ? Vector2{ dx / distance, dy / distance } : Vector2{ 0, -1 };
+        // Индекс собран после движения и расталкивания врагов
+        laser->hitCount = RaycastEnemies(game->enemyIndex, laser->origin, laser->direction, LASER_RANGE, laser->hits, MAX_ENEMIES);
+        for (h = 0; h < laser->hitCount && !bossDefeated; h++) {
+            int j = laser->hits[h].enemy;
+            if (health[j] <= 0) {
+                continue;
+            }
+            bossDefeated = EmitEnemyHit(game, health, j, HIT_SOURCE_LASER, EntityHandle{ 0, 0 }, LASER_DAMAGE * game->player.damageMultiplier);
+        }
+    }
+
+    // Время прохода делится между архетипами пропорционально числу проверок
+    int tests[ARCHETYPE_COUNT] = { 0 };
+    int testCount = 0;
+    for (int w = 0; w <= JOB_MAX_WORKERS; w++) {
+        for (int a = 0; a < ARCHETYPE_COUNT; a++) {
+            tests[a] += buffers->tests[w][a];
+            testCount += buffers->tests[w][a];
+        }
+    }
+    if (testCount > 0) {
+        double time = GetTime() - start;
+        for (int a = 0; a < ARCHETYPE_COUNT; a++) {
+            game->profiler.current[a].collisionTime += time * tests[a] / testCount;
+        }
+    }
+}
 
-    game.newGameButton = CreateButton(WIDTH / 2, 250, 200, 50, "NEW GAME", BLUE, DARKBLUE);
-    game.continueButton = CreateButton(WIDTH / 2, 320, 200, 50, "CONTINUE", BLUE, DARKBLUE);
-    game.quitButton = CreateButton(WIDTH / 2, 390, 200, 50, "QUIT", BLUE, DARKBLUE);
+// Пули босса и стрелков по игроку. Время записывается на их архетипы.
+void DetectPlayerHits(Game* game) {
+    double bossStart = GetTime();
+    int now = game->timers->now;
+    for (int i = 0; i < game->bossBulletCount; i++) {
+        BossBullet* bullet = &game->bossBullets[i];
+        Vector2 position = ProjectilePosition(bullet->motion, now);
+        if (ProjectileCollidesWithPlayer(bullet->motion, bullet->radius, game->player, now)) {
+            PushGameEvent(game, GAME_EVENT_PLAYER_DAMAGED, HIT_SOURCE_BOSS_BULLET, EntityHandle{ 0, 0 },
+                SlotMapHandle(&game->bossBulletSlots, i), bullet->damage, position.x, position.y);
+        }
+    }
 
-    return game;
+    double shooterStart = GetTime();
+    game->profiler.current[ARCHETYPE_BOSS].collisionTime += shooterStart - bossStart;
+    for (int i = 0; i < game->enemyBulletCount; i++) {
+        EnemyBullet* bullet = &game->enemyBullets[i];
+        Vector2 position = ProjectilePosition(bullet->motion, now);
+        if (ProjectileCollidesWithPlayer(bullet->motion, bullet->radius, game->player, now)) {
+            PushGameEvent(game, GAME_EVENT_PLAYER_DAMAGED, HIT_SOURCE_ENEMY_BULLET, EntityHandle{ 0, 0 },
+                SlotMapHandle(&game->enemyBulletSlots, i), bullet->damage, position.x, position.y);
+        }
+    }
+    game->profiler.current[ARCHETYPE_SHOOTER].collisionTime += GetTime() - shooterStart;
 }
 
-void SpawnEnemy(Game* game) {
-    if (game->enemyCount < MAX_ENEMIES) {
-        // НА 3 УРОВНЕ СПАВНИМ ТОЛЬКО БОССА
-        if (game->level == 3) {
-            if (!game->bossSpawned) {
-                game->enemies[game->enemyCount] = CreateEnemy(3, false, true, false, false, false, game->player);
-                game->enemyCount++;
-                game->bossSpawned = true;
-                printf("BOSS SPAWNED!\n");
-            }
-            return;
+// Подбор бонусов. Бонусы с истёкшим временем убираются сразу.
+void DetectBonusPickups(Game* game) {
+    for (int i = game->bonusCount - 1; i >= 0; i--) {
+        if (ShouldRemoveBonus(game->bonuses[i])) {
+            SlotMapErase(&game->bonusSlots, game->bonuses, sizeof(HatBonus), &game->bonusCount, i);
         }
+    }
 
-        // Шансы спавна разных типов врагов в зависимости от уровня
-        int spawnType = GetRandomValue(0, 100);
+    for (int i = 0; i < game->bonusCount; i++) {
+        HatBonus* bonus = &game->bonuses[i];
+        if (BonusCollidesWithPlayer(*bonus, game->player)) {
+            PushGameEvent(game, GAME_EVENT_BONUS_COLLECTED, HIT_SOURCE_NONE, SlotMapHandle(&game->bonusSlots, i),
+                EntityHandle{ 0, 0 }, 0, bonus->x, bonus->y);
+        }
+    }
+}
 
-        if (game->level == 1) {
-            // На 1 уровне только обычные враги
-            if (spawnType < 70) {
-                game->enemies[game->enemyCount] = CreateEnemy(1, false, false, false, false, false, game->player);
+// Снаряд, попавший в цель, исчезает. Враг после удара по игроку остаётся.
+void EraseHitSource(Game* game, HitSource source, EntityHandle handle) {
+    int index;
+    switch (source) {
+    case HIT_SOURCE_BULLET:
+        index = SlotMapFind(&game->bulletSlots, handle);
+        if (index >= 0) SlotMapErase(&game->bulletSlots, game->bullets, sizeof(Bullet), &game->bulletCount, index);
+        break;
+    case HIT_SOURCE_KNIFE:
+        index = SlotMapFind(&game->knifeSlots, handle);
+        if (index >= 0) SlotMapErase(&game->knifeSlots, game->knives, sizeof(Knife), &game->knifeCount, index);
+        break;
+    case HIT_SOURCE_BOSS_BULLET:
+        index = SlotMapFind(&game->bossBulletSlots, handle);
+        if (index >= 0) SlotMapErase(&game->bossBulletSlots, game->bossBullets, sizeof(BossBullet), &game->bossBulletCount, index);
+        break;
+    case HIT_SOURCE_ENEMY_BULLET:
+        index = SlotMapFind(&game->enemyBulletSlots, handle);
+        if (index >= 0) SlotMapErase(&game->enemyBulletSlots, game->enemyBullets, sizeof(EnemyBullet), &game->enemyBulletCount, index);
+        break;
+    default:
+        break;
+    }
+}
+
+// ПРИМЕНЕНИЕ СОБЫТИЙ ТИКА
+// События ссылаются на сущности хэндлами, поэтому удалять можно сразу:
+// перестановка массивов не ломает ссылки следующих событий.
+void ApplyGameEvents(Game* game) {
+    // Очередь может расти по ходу применения - убийства добавляют LEVEL_COMPLETE
+    for (int e = 0; e < game->events.count; e++) {
+        GameEvent* event = &game->events.events[e];
+        switch (event->type) {
+        case GAME_EVENT_HIT: {
+            int index = SlotMapFind(&game->enemySlots, event->target);
+            if (index >= 0) {
+                EnemyTakeDamage(&game->enemies[index], event->amount);
+                EmitParticles(game->particles, event->x, event->y, game->enemies[index].color, 6, 2.5f, 20);
             }
-            else if (spawnType < 85) {
-                game->enemies[game->enemyCount] = CreateEnemy(1, false, false, false, false, true, game->player); // Бегун
+            EraseHitSource(game, (HitSource)event->source, event->sourceHandle);
+            break;
+        }
+
+        case GAME_EVENT_KILL: {
+            int index = SlotMapFind(&game->enemySlots, event->target);
+            if (index >= 0) {
+                bool boss = event->archetype == ARCHETYPE_BOSS;
+                EmitParticles(game->particles, event->x, event->y, game->enemies[index].color, boss ? 600 : 40, boss ? 7.0f : 4.0f, boss ? 90 : 45);
+                SlotMapErase(&game->enemySlots, game->enemies, sizeof(Enemy), &game->enemyCount, index);
             }
-            else {
-                game->enemies[game->enemyCount] = CreateEnemy(1, false, false, true, false, false, game->player); // Стрелок
+            game->score += event->amount;
+            game->enemiesDefeated++;
+            if (game->level == 3 && event->archetype == ARCHETYPE_BOSS) {
+                break;
+            }
+
+            int bonusChance = event->source == HIT_SOURCE_KNIFE ? 15 : 10;
+            if (GetRandomValue(0, 100) < bonusChance) {
+                SpawnHatBonus(game, event->x, event->y);
+            }
+            if (game->level < 3 && game->enemiesDefeated == game->enemiesToDefeat) {
+                PushGameEvent(game, GAME_EVENT_LEVEL_COMPLETE, HIT_SOURCE_NONE, EntityHandle{ 0, 0 }, EntityHandle{ 0, 0 }, game->level, 0, 0);
             }
+            break;
         }
-        else if (game->level == 2) {
-            // На 2 уровне появляются все типы
-            if (spawnType < 40) {
-                game->enemies[game->enemyCount] = CreateEnemy(2, false, false, false, false, false, game->player);
+
+        case GAME_EVENT_PLAYER_DAMAGED:
+            if (!game->player.invincible) {
+                RescheduleTimer(game->timers, &game->invincibleTimer, TIMER_PLAYER_INVINCIBLE, game->timers->now + 90, EntityHandle{ 0, 0 });
             }
-            else if (spawnType < 60) {
-                game->enemies[game->enemyCount] = CreateEnemy(2, false, false, false, false, true, game->player); // Бегун
+            PlayerTakeDamage(&game->player, event->amount);
+            if (event->source == HIT_SOURCE_ENEMY) {
+                int index = SlotMapFind(&game->enemySlots, event->sourceHandle);
+                if (index >= 0) {
+                    game->enemies[index].attackReadyTick = game->timers->now + ENEMY_CONTACT_COOLDOWN;
+                }
             }
-            else if (spawnType < 75) {
-                game->enemies[game->enemyCount] = CreateEnemy(2, false, false, true, false, false, game->player); // Стрелок
+            EraseHitSource(game, (HitSource)event->source, event->sourceHandle);
+            break;
+
+        case GAME_EVENT_BONUS_COLLECTED: {
+            int index = SlotMapFind(&game->bonusSlots, event->target);
+            if (index < 0) {
+                break;
             }
-            else if (spawnType < 85) {
-                game->enemies[game->enemyCount] = CreateEnemy(2, false, false, false, true, false, game->player); // Танк
+            if (strcmp(game->bonuses[index].bonusType, "damage") == 0) {
+                AddDamageBonus(&game->player);
+                RescheduleTimer(game->timers, &game->damageBonusTimer, TIMER_PLAYER_BONUS, game->timers->now + 600, EntityHandle{ 0, 0 });
+                CancelTimer(game->timers, game->laserTimer);
             }
-            else if (spawnType < 92) {
-                game->enemies[game->enemyCount] = CreateEnemy(2, true, false, false, false, false, game->player); // Элитный
+            else if (strcmp(game->bonuses[index].bonusType, "laser") == 0) {
+                AddLaserBonus(&game->player);
+                RescheduleTimer(game->timers, &game->laserTimer, TIMER_PLAYER_LASER, game->timers->now + LASER_DURATION, EntityHandle{ 0, 0 });
+                CancelTimer(game->timers, game->damageBonusTimer);
             }
             else {
-                game->enemies[game->enemyCount] = CreateEnemy(3, false, false, false, false, false, game->player); // Сильный обычный
+                AddKnifeBonus(&game->player);
+                CancelTimer(game->timers, game->damageBonusTimer);
+                CancelTimer(game->timers, game->laserTimer);
             }
+            SlotMapErase(&game->bonusSlots, game->bonuses, sizeof(HatBonus), &game->bonusCount, index);
+            break;
         }
 
-        game->enemyCount++;
+        case GAME_EVENT_BOSS_DEFEATED:
+            // Игра окончена, дальше мир не меняется
+            game->bossDefeated = true;
+            strcpy(game->state, "victory");
+            return;
+
+        case GAME_EVENT_LEVEL_COMPLETE:
+            strcpy(game->state, "level_complete");
+            game->levelCompleteTimer = 0;
+            break;
+
+        default:
+            break;
+        }
     }
 }
 
-void SpawnHatBonus(Game* game, float x, float y) {
-    if (game->bonusCount < MAX_BONUSES) {
-        const char* bonusType = (GetRandomValue(0, 100) < 50) ? "damage" : "knife";
-        game->bonuses[game->bonusCount] = CreateHatBonus(x, y, bonusType);
-        game->bonusCount++;
+// Запоминает позиции всех сущностей перед тиком
+void StorePreviousPositions(Game* game) {
+    game->player.prevX = game->player.x;
+    game->player.prevY = game->player.y;
+    for (int i = 0; i < game->bulletCount; i++) {
+        game->bullets[i].prevX = game->bullets[i].x;
+        game->bullets[i].prevY = game->bullets[i].y;
+    }
+    for (int i = 0; i < game->enemyCount; i++) {
+        game->enemies[i].prevX = game->enemies[i].x;
+        game->enemies[i].prevY = game->enemies[i].y;
+    }
+    for (int i = 0; i < game->bonusCount; i++) {
+        game->bonuses[i].prevX = game->bonuses[i].x;
+        game->bonuses[i].prevY = game->bonuses[i].y;
+    }
+    for (int i = 0; i < game->knifeCount; i++) {
+        game->knives[i].prevX = game->knives[i].x;
+        game->knives[i].prevY = game->knives[i].y;
     }
 }
 
-void StartNewGame(Game* game) {
-    strcpy(game->state, "playing");
-    game->level = 1;
-    game->score = 0;
-    game->enemiesDefeated = 0;
-    game->enemiesToDefeat = 10;
-    game->player = CreatePlayer();
-    game->bulletCount = 0;
-    game->bossBulletCount = 0;
-    game->enemyBulletCount = 0;
-    game->enemyCount = 0;
-    game->bonusCount = 0;
-    game->knifeCount = 0;
-    game->bossSpawned = false;
-    game->bossDefeated = false;
-}
+// Меню, ESC и отладочные клавиши; false - выход из игры
+bool HandleStateInput(Game* game, TickInput* input) {
+    if (InputPressed(input, INPUT_TOGGLE_PROFILER)) {
+        game->profiler.showOverlay = !game->profiler.showOverlay;
+    }
+    // F4 - режим замера задержки "ввод -> кадр"
+    if (InputPressed(input, INPUT_TOGGLE_LATENCY)) {
+        game->latency.enabled = !game->latency.enabled;
+        ResetLatencyTracker(&game->latency);
+    }
+    // F5 - расталкивание толпы
+    if (InputPressed(input, INPUT_TOGGLE_SEPARATION)) {
+        game->separation->enabled = !game->separation->enabled;
+    }
 
-void StartNextLevel(Game* game) {
-    if (game->level < game->maxLevel) {
-        game->level++;
-        game->enemiesDefeated = 0;
-        game->bulletCount = 0;
-        game->bossBulletCount = 0;
-        game->enemyBulletCount = 0;
-        game->enemyCount = 0;
-        game->bonusCount = 0;
-        game->knifeCount = 0;
-        game->enemiesToDefeat = (game->level == 3) ? 1 : 15;
-        game->bossSpawned = false;
-        game->bossDefeated = false;
+    if (strcmp(game->state, "menu") == 0) {
+        if (InputPressed(input, INPUT_FIRE)) {
+            if (CheckCollisionPointRec(input->fireAim, game->newGameButton.rect)) {
+                StartNewGame(game);
+            }
+            else if (CheckCollisionPointRec(input->fireAim, game->quitButton.rect)) {
+                return false;
+            }
+        }
     }
-    else {
-        strcpy(game->state, "victory");
+    else if (strcmp(game->state, "playing") == 0) {
+        if (InputPressed(input, INPUT_BACK)) {
+            strcpy(game->state, "menu");
+        }
+    }
+    else if (strcmp(game->state, "game_over") == 0 || strcmp(game->state, "victory") == 0) {
+        if (InputPressed(input, INPUT_BACK)) {
+            strcpy(game->state, "menu");
+        }
     }
+    return true;
 }
 
-void UpdateGame(Game* game) {
+void UpdateGame(Game* game, TickInput* input) {
+    // События живут до следующего тика - их можно прочитать после UpdateGame
+    game->events.count = 0;
+    game->tick++;
+
+    // Эффекты догорают и после конца уровня
+    double particleStart = GetTime();
+    UpdateParticles(game->particles);
+    game->profiler.particleTime += GetTime() - particleStart;
+
     if (strcmp(game->state, "playing") == 0) {
-        MovePlayer(&game->player);
-        UpdatePlayer(&game->player);
+        StorePreviousPositions(game);
+        // Вид, который игрок видел, когда целился
+        game->view = WorldView(game->player.x, game->player.y);
+        Vector2 aim = ViewToWorld(game->view, input->aim);
+        Vector2 fireAim = ViewToWorld(game->view, input->fireAim);
+        // Оружие игрока и ножи ищут цели по позициям на начало тика. Прошлый
+        // индекс не годится: после него враги удалялись и появлялись.
+        BuildEnemyIndex(game->enemyIndex, game->enemies, game->enemyCount);
+
+        // Замер задержки: нажатия, попавшие в этот тик
+        for (int b = INPUT_LEFT; b <= INPUT_DOWN; b++) {
+            if (InputPressed(input, (InputButton)b)) {
+                LatencySample(&game->latency, INPUT_EVENT_MOVE, input->pressTime[b]);
+                break;
+            }
+        }
+        if (InputPressed(input, INPUT_FIRE)) {
+            LatencySample(&game->latency, INPUT_EVENT_FIRE, input->pressTime[INPUT_FIRE]);
+        }
+        if (InputPressed(input, INPUT_KNIVES)) {
+            LatencySample(&game->latency, INPUT_EVENT_KNIVES, input->pressTime[INPUT_KNIVES]);
+        }
+
+        float prevX = game->player.x;
+        float prevY = game->player.y;
+        MovePlayer(&game->player, input);
+        if (game->player.x != prevX || game->player.y != prevY) {
+            LatencyConsume(&game->latency, INPUT_EVENT_MOVE);
+        }
 
         // АКТИВАЦИЯ НОЖЕЙ ПРАВОЙ КНОПКОЙ МЫШИ
-        if (IsMouseButtonPressed(MOUSE_RIGHT_BUTTON) && game->player.hasKnifeBonus) {
+        if (InputPressed(input, INPUT_KNIVES) && game->player.hasKnifeBonus) {
+            int firstKnife = game->knifeCount;
             CreatePlayerKnives(game->player, game->knives, &game->knifeCount);
+            AimPlayerKnives(game, firstKnife);
+            SlotMapAdopt(&game->knifeSlots, game->knifeCount);
             game->player.hasKnifeBonus = false;
+            LatencyConsume(&game->latency, INPUT_EVENT_KNIVES);
         }
 
         // НЕПРЕРЫВНАЯ СТРЕЛЬБА ПРИ ЗАЖАТОЙ ЛКМ
-        if (IsMouseButtonDown(MOUSE_LEFT_BUTTON)) {
-            if (game->player.shootCooldown <= 0 && game->bulletCount < MAX_BULLETS) {
-                Vector2 mousePos = GetMousePosition();
+        game->laser.firing = game->player.hasLaser && InputDown(input, INPUT_FIRE);
+        if (game->laser.firing) {
+            game->laser.aim = InputPressed(input, INPUT_FIRE) ? fireAim : aim;
+            LatencyConsume(&game->latency, INPUT_EVENT_FIRE);
+        }
+        else if (InputDown(input, INPUT_FIRE)) {
+            if ((int)game->timers->now >= game->player.shootReadyTick && game->bulletCount < MAX_BULLETS) {
+                // Прицел на момент нажатия, если ЛКМ нажата в этом тике
+                Vector2 mousePos = InputPressed(input, INPUT_FIRE) ? fireAim : aim;
+                mousePos = LockOnAim(game, mousePos);
                 game->bullets[game->bulletCount] = CreateBullet(
                     game->player.x, game->player.y,
                     mousePos.x, mousePos.y,
                     game->level, game->player.damageMultiplier
                 );
                 game->bulletCount++;
-                game->player.shootCooldown = 10;
+                SlotMapAdopt(&game->bulletSlots, game->bulletCount);
+                game->player.shootReadyTick = game->timers->now + 10;
+                LatencyConsume(&game->latency, INPUT_EVENT_FIRE);
             }
         }
 
         if (!IsPlayerAlive(game->player)) {
+            LOG("game over at tick %d: level %d, score %d", game->tick, game->level, game->score);
             strcpy(game->state, "game_over");
             return;
         }
@@ -1094,216 +6126,66 @@ void UpdateGame(Game* game) {
             SpawnEnemy(game);
         }
 
-        // НА 3 УРОВНЕ НЕ СПАВНИМ ОБЫЧНЫХ ВРАГОВ
-        if (game->level < 3) {
-            game->enemySpawnTimer++;
-            int spawnRate = 70 - game->level * 10;
-            if (spawnRate < 30) spawnRate = 30;
-
-            if (game->enemySpawnTimer >= spawnRate) {
-                SpawnEnemy(game);
-                game->enemySpawnTimer = 0;
-            }
-        }
-
-        game->bonusSpawnTimer++;
-        if (game->bonusSpawnTimer >= 450 && GetRandomValue(0, 100) < 15) {
-            SpawnHatBonus(game, GetRandomValue(50, WIDTH - 50), -50);
-            game->bonusSpawnTimer = 0;
-        }
-
-        // Обновление пуль игрока
-        for (int i = 0; i < game->bulletCount; i++) {
-            UpdateBullet(&game->bullets[i]);
-            if (IsBulletOffScreen(game->bullets[i])) {
-                for (int j = i; j < game->bulletCount - 1; j++) {
-                    game->bullets[j] = game->bullets[j + 1];
-                }
-                game->bulletCount--;
-                i--;
-            }
-        }
-
-        // Обновление пуль босса
-        for (int i = 0; i < game->bossBulletCount; i++) {
-            UpdateBossBullet(&game->bossBullets[i]);
-            if (IsBossBulletOffScreen(game->bossBullets[i])) {
-                for (int j = i; j < game->bossBulletCount - 1; j++) {
-                    game->bossBullets[j] = game->bossBullets[j + 1];
-                }
-                game->bossBulletCount--;
-                i--;
-            }
-        }
-
-        // Обновление пуль врагов
-        for (int i = 0; i < game->enemyBulletCount; i++) {
-            UpdateEnemyBullet(&game->enemyBullets[i]);
-            if (IsEnemyBulletOffScreen(game->enemyBullets[i])) {
-                for (int j = i; j < game->enemyBulletCount - 1; j++) {
-                    game->enemyBullets[j] = game->enemyBullets[j + 1];
-                }
-                game->enemyBulletCount--;
-                i--;
-            }
-        }
-
-        // Обновление ножей
-        for (int i = 0; i < game->knifeCount; i++) {
-            UpdateKnife(&game->knives[i]);
-            if (IsKnifeOffScreen(game->knives[i])) {
-                for (int j = i; j < game->knifeCount - 1; j++) {
-                    game->knives[j] = game->knives[j + 1];
-                }
-                game->knifeCount--;
-                i--;
-            }
-        }
-
-        // ПРОВЕРКА СТОЛКНОВЕНИЙ ПУЛЬ С ВРАГАМИ
+        // Появление врагов и бонусов, выстрелы, конец неуязвимости и бонусов
+        RunTimers(game);
+
+        // Движение снарядов игрока: интеграция кусками параллельно, затем удаление улетевших.
+        // Пули босса и стрелков считаются по формуле, их убирают таймеры колеса.
+        JobGraph projectiles;
+        InitJobGraph(&projectiles);
+        int integrateBullets = AddJobPhase(&projectiles, "integrate_bullets", IntegrateBulletsJob, game, game->bulletCount, JOB_PARALLEL_MIN, JOB_CHUNK);
+        int integrateKnives = AddJobPhase(&projectiles, "integrate_knives", IntegrateKnivesJob, game, game->knifeCount, JOB_PARALLEL_MIN, JOB_CHUNK);
+        AddJobDependency(&projectiles, AddJobPhase(&projectiles, "compact_bullets", CompactBulletsJob, game, 1, JOB_PARALLEL_MIN, JOB_CHUNK), integrateBullets);
+        AddJobDependency(&projectiles, AddJobPhase(&projectiles, "compact_knives", CompactKnivesJob, game, 1, JOB_PARALLEL_MIN, JOB_CHUNK), integrateKnives);
+        RunJobGraph(game->jobs, &projectiles);
+
+        // Обновление врагов: решения по бюджету, затем движение. Дальние
+        // преследователи идут одним пакетом, ближние - полным путём с замером.
+        UpdateFlowField(game->flow, game->player);
+        RunAiScheduler(game);
+        StepFarEnemies(game);
         for (int i = 0; i < game->enemyCount; i++) {
-            UpdateEnemy(&game->enemies[i], game->player, game->bossBullets, &game->bossBulletCount, game->enemyBullets, &game->enemyBulletCount);
-
-            if (IsEnemyOffScreen(game->enemies[i])) {
-                for (int j = i; j < game->enemyCount - 1; j++) {
-                    game->enemies[j] = game->enemies[j + 1];
-                }
-                game->enemyCount--;
-                i--;
-                continue;
-            }
-
-            if (EnemyCollidesWithPlayer(game->enemies[i], game->player)) {
-                PlayerTakeDamage(&game->player, game->enemies[i].damage);
-            }
-
-            for (int j = 0; j < game->bulletCount; j++) {
-                float distance = sqrt(pow(game->bullets[j].x - game->enemies[i].x, 2) + pow(game->bullets[j].y - game->enemies[i].y, 2));
-                if (distance < game->bullets[j].radius + game->enemies[i].radius) {
-                    if (EnemyTakeDamage(&game->enemies[i], game->bullets[j].damage)) {
-                        game->score += game->enemies[i].scoreValue;
-                        game->enemiesDefeated++;
-
-                        // ПРОВЕРКА ПОБЕДЫ НАД БОССОМ
-                        if (game->level == 3 && game->enemies[i].isBoss) {
-                            game->bossDefeated = true;
-                            strcpy(game->state, "victory");
-                            return;
-                        }
-
-                        if (GetRandomValue(0, 100) < 10) {
-                            SpawnHatBonus(game, game->enemies[i].x, game->enemies[i].y);
-                        }
-
-                        for (int k = i; k < game->enemyCount - 1; k++) {
-                            game->enemies[k] = game->enemies[k + 1];
-                        }
-                        game->enemyCount--;
-                        i--;
-                    }
-
-                    for (int k = j; k < game->bulletCount - 1; k++) {
-                        game->bullets[k] = game->bullets[k + 1];
-                    }
-                    game->bulletCount--;
-                    j--;
-                    break;
-                }
-            }
-        }
-
-        // ПРОВЕРКА СТОЛКНОВЕНИЙ НОЖЕЙ С ВРАГАМИ
-        for (int i = 0; i < game->knifeCount; i++) {
-            for (int j = 0; j < game->enemyCount; j++) {
-                float distance = sqrt(pow(game->knives[i].x - game->enemies[j].x, 2) + pow(game->knives[i].y - game->enemies[j].y, 2));
-                if (distance < game->knives[i].radius + game->enemies[j].radius) {
-                    if (EnemyTakeDamage(&game->enemies[j], 3)) {
-                        game->score += game->enemies[j].scoreValue;
-                        game->enemiesDefeated++;
-
-                        // ПРОВЕРКА ПОБЕДЫ НАД БОССОМ
-                        if (game->level == 3 && game->enemies[j].isBoss) {
-                            game->bossDefeated = true;
-                            strcpy(game->state, "victory");
-                            return;
-                        }
-
-                        if (GetRandomValue(0, 100) < 15) {
-                            SpawnHatBonus(game, game->enemies[j].x, game->enemies[j].y);
-                        }
-
-                        for (int k = j; k < game->enemyCount - 1; k++) {
-                            game->enemies[k] = game->enemies[k + 1];
-                        }
-                        game->enemyCount--;
-                        j--;
-                    }
-
-                    for (int k = i; k < game->knifeCount - 1; k++) {
-                        game->knives[k] = game->knives[k + 1];
-                    }
-                    game->knifeCount--;
+            if (game->enemies[i].isFar) {
+                if (IsEnemyOutsideWorld(game->enemies[i])) {
+                    SlotMapErase(&game->enemySlots, game->enemies, sizeof(Enemy), &game->enemyCount, i);
                     i--;
-                    break;
                 }
+                continue;
             }
-        }
-
-        // ПРОВЕРКА СТОЛКНОВЕНИЙ ПУЛЬ БОССА С ИГРОКОМ
-        for (int i = 0; i < game->bossBulletCount; i++) {
-            if (BossBulletCollidesWithPlayer(game->bossBullets[i], game->player)) {
-                PlayerTakeDamage(&game->player, game->bossBullets[i].damage);
-                for (int j = i; j < game->bossBulletCount - 1; j++) {
-                    game->bossBullets[j] = game->bossBullets[j + 1];
-                }
-                game->bossBulletCount--;
-                i--;
+            ArchetypeCost* cost = &game->profiler.current[GetEnemyArchetype(game->enemies[i])];
+            double updateStart = GetTime();
+            bool wasStopped = game->enemies[i].hasStopped;
+            UpdateEnemy(&game->enemies[i]);
+            if (!wasStopped && game->enemies[i].hasStopped) {
+                StartEnemyAttacks(game, i);
             }
-        }
+            cost->updateTime += GetTime() - updateStart;
+            cost->enemyTicks++;
 
-        // ПРОВЕРКА СТОЛКНОВЕНИЙ ПУЛЬ ВРАГОВ С ИГРОКОМ
-        for (int i = 0; i < game->enemyBulletCount; i++) {
-            if (EnemyBulletCollidesWithPlayer(game->enemyBullets[i], game->player)) {
-                PlayerTakeDamage(&game->player, game->enemyBullets[i].damage);
-                for (int j = i; j < game->enemyBulletCount - 1; j++) {
-                    game->enemyBullets[j] = game->enemyBullets[j + 1];
-                }
-                game->enemyBulletCount--;
+            // На место удалённого встаёт последний враг, он ещё не обновлялся
+            if (IsEnemyOutsideWorld(game->enemies[i])) {
+                SlotMapErase(&game->enemySlots, game->enemies, sizeof(Enemy), &game->enemyCount, i);
                 i--;
             }
         }
 
-        for (int i = 0; i < game->bonusCount; i++) {
-            UpdateHatBonus(&game->bonuses[i]);
-            if (ShouldRemoveBonus(game->bonuses[i])) {
-                for (int j = i; j < game->bonusCount - 1; j++) {
-                    game->bonuses[j] = game->bonuses[j + 1];
-                }
-                game->bonusCount--;
-                i--;
-            }
-            else if (BonusCollidesWithPlayer(game->bonuses[i], game->player)) {
-                if (strcmp(game->bonuses[i].bonusType, "damage") == 0) {
-                    AddDamageBonus(&game->player);
-                }
-                else {
-                    AddKnifeBonus(&game->player);
-                }
+        // Второй и последний индекс за тик: позиции после движения, ни одного
+        // удаления до применения событий. Его берут расталкивание и лазер.
+        BuildEnemyIndex(game->enemyIndex, game->enemies, game->enemyCount);
+        SeparateEnemies(game);
 
-                for (int j = i; j < game->bonusCount - 1; j++) {
-                    game->bonuses[j] = game->bonuses[j + 1];
-                }
-                game->bonusCount--;
-                i--;
-            }
-        }
+        JobGraph bonuses;
+        InitJobGraph(&bonuses);
+        AddJobPhase(&bonuses, "integrate_bonuses", IntegrateBonusesJob, game, game->bonusCount, JOB_PARALLEL_MIN, JOB_CHUNK);
+        RunJobGraph(game->jobs, &bonuses);
 
-        // ПРОВЕРКА ЗАВЕРШЕНИЯ УРОВНЯ ДЛЯ УРОВНЕЙ 1-2
-        if (game->level < 3 && game->enemiesDefeated >= game->enemiesToDefeat) {
-            strcpy(game->state, "level_complete");
-            game->levelCompleteTimer = 0;
-        }
+        // ПОИСК СТОЛКНОВЕНИЙ - только события, мир не меняется
+        DetectEnemyCollisions(game);
+        DetectPlayerHits(game);
+        DetectBonusPickups(game);
 
+        // ПРИМЕНЕНИЕ ВСЕХ СОБЫТИЙ ТИКА
+        ApplyGameEvents(game);
     }
     else if (strcmp(game->state, "level_complete") == 0) {
         game->levelCompleteTimer++;
@@ -1314,63 +6196,135 @@ void UpdateGame(Game* game) {
     }
 }
 
-void DrawGame(Game game) {
+// alpha - доля прошедшего следующего тика: рисуем между прошлым и текущим состоянием
+void DrawGame(Game* game, float alpha) {
     ClearBackground(SKYBLUE);
+    // Рисуем в логических координатах, камера растягивает их до внутреннего разрешения
+    float zoom = game->present->scale;
+    Camera2D screen = { { 0, 0 }, { 0, 0 }, 0.0f, zoom };
+    BeginMode2D(screen);
 
-    if (strcmp(game.state, "menu") == 0) {
+    if (strcmp(game->state, "menu") == 0) {
         DrawText("CRAZY HATMAN", WIDTH / 2 - 180, 100, 50, DARKBLUE);
         DrawText("Controls:", WIDTH / 2 - 50, 160, 24, DARKBLUE);
         DrawText("Arrows - Move", WIDTH / 2 - 70, 190, 20, DARKBLUE);
         DrawText("LMB (Hold) - Auto Shoot", WIDTH / 2 - 100, 215, 20, DARKBLUE);
         DrawText("RMB - Knives (if bonus)", WIDTH / 2 - 100, 240, 20, DARKBLUE);
 
-        UpdateButton(&game.newGameButton);
-        UpdateButton(&game.continueButton);
-        UpdateButton(&game.quitButton);
+        UpdateButton(&game->newGameButton);
+        UpdateButton(&game->continueButton);
+        UpdateButton(&game->quitButton);
 
-        DrawButton(game.newGameButton);
-        DrawButton(game.continueButton);
-        DrawButton(game.quitButton);
+        DrawButton(game->newGameButton);
+        DrawButton(game->continueButton);
+        DrawButton(game->quitButton);
 
     }
-    else if (strcmp(game.state, "playing") == 0) {
-        DrawPlayer(game.player);
+    else if (strcmp(game->state, "playing") == 0) {
+        Player player = game->player;
+        player.x = Interpolate(player.prevX, player.x, alpha);
+        player.y = Interpolate(player.prevY, player.y, alpha);
+
+        // Камера следует за игроком; всё, что вне вида, не рисуется
+        Rectangle view = WorldView(player.x, player.y);
+        Camera2D camera = { { 0, 0 }, { view.x, view.y }, 0.0f, zoom };
+        long long culled = 0;
+        EndMode2D();
+        BeginMode2D(camera);
+        DrawArena(view);
+        DrawPlayer(player, ViewToWorld(view, GetMousePosition()));
+
+        for (int i = 0; i < game->bulletCount; i++) {
+            Bullet bullet = game->bullets[i];
+            bullet.x = Interpolate(bullet.prevX, bullet.x, alpha);
+            bullet.y = Interpolate(bullet.prevY, bullet.y, alpha);
+            if (!IsInView(view, bullet.x, bullet.y, bullet.radius)) {
+                culled++;
+                continue;
+            }
+            DrawBullet(bullet);
+        }
 
-        for (int i = 0; i < game.bulletCount; i++) {
-            DrawBullet(game.bullets[i]);
+        int now = game->timers->now;
+        for (int i = 0; i < game->bossBulletCount; i++) {
+            BossBullet bullet = game->bossBullets[i];
+            Vector2 position = ProjectileDrawPosition(bullet.motion, now, alpha);
+            if (!IsInView(view, position.x, position.y, bullet.radius)) {
+                culled++;
+                continue;
+            }
+            DrawBossBullet(bullet, position);
         }
 
-        for (int i = 0; i < game.bossBulletCount; i++) {
-            DrawBossBullet(game.bossBullets[i]);
+        for (int i = 0; i < game->enemyBulletCount; i++) {
+            EnemyBullet bullet = game->enemyBullets[i];
+            Vector2 position = ProjectileDrawPosition(bullet.motion, now, alpha);
+            if (!IsInView(view, position.x, position.y, bullet.radius)) {
+                culled++;
+                continue;
+            }
+            DrawEnemyBullet(bullet, position);
         }
 
-        for (int i = 0; i < game.enemyBulletCount; i++) {
-            DrawEnemyBullet(game.enemyBullets[i]);
+        for (int i = 0; i < game->enemyCount; i++) {
+            Enemy enemy = game->enemies[i];
+            enemy.x = Interpolate(enemy.prevX, enemy.x, alpha);
+            enemy.y = Interpolate(enemy.prevY, enemy.y, alpha);
+            if (!IsInView(view, enemy.x, enemy.y, enemy.radius + CULL_MARGIN)) {
+                culled++;
+                continue;
+            }
+            ArchetypeCost* cost = &game->profiler.current[GetEnemyArchetype(enemy)];
+            double drawStart = GetTime();
+            DrawEnemy(enemy, game->quality.tier);
+            cost->drawTime += GetTime() - drawStart;
+            cost->enemyDraws++;
         }
 
-        for (int i = 0; i < game.enemyCount; i++) {
-            DrawEnemy(game.enemies[i]);
+        for (int i = 0; i < game->bonusCount; i++) {
+            HatBonus bonus = game->bonuses[i];
+            bonus.x = Interpolate(bonus.prevX, bonus.x, alpha);
+            bonus.y = Interpolate(bonus.prevY, bonus.y, alpha);
+            if (!IsInView(view, bonus.x, bonus.y, CULL_MARGIN)) {
+                culled++;
+                continue;
+            }
+            DrawHatBonus(bonus);
         }
 
-        for (int i = 0; i < game.bonusCount; i++) {
-            DrawHatBonus(game.bonuses[i]);
+        for (int i = 0; i < game->knifeCount; i++) {
+            Knife knife = game->knives[i];
+            knife.x = Interpolate(knife.prevX, knife.x, alpha);
+            knife.y = Interpolate(knife.prevY, knife.y, alpha);
+            if (!IsInView(view, knife.x, knife.y, 10)) {
+                culled++;
+                continue;
+            }
+            DrawKnife(knife);
         }
 
-        for (int i = 0; i < game.knifeCount; i++) {
-            DrawKnife(game.knives[i]);
+        double particleStart = GetTime();
+        DrawParticles(game->particles, alpha, view);
+        game->profiler.particleTime += GetTime() - particleStart;
+
+        if (game->laser.firing) {
+            DrawLaserBeam(&game->laser);
         }
+        EndMode2D();
+        BeginMode2D(screen);
+        game->profiler.culledDraws += culled;
 
         char scoreText[50];
-        sprintf(scoreText, "Score: %d", game.score);
+        sprintf(scoreText, "Score: %d", game->score);
         DrawText(scoreText, 10, 10, 24, DARKBLUE);
 
         char levelText[50];
-        sprintf(levelText, "Level: %d", game.level);
+        sprintf(levelText, "Level: %d", game->level);
         DrawText(levelText, 10, 40, 24, DARKBLUE);
 
         char enemiesText[50];
-        if (game.level == 3) {
-            if (game.bossSpawned) {
+        if (game->level == 3) {
+            if (game->bossSpawned) {
                 sprintf(enemiesText, "BOSS: ALIVE");
             }
             else {
@@ -1378,34 +6332,41 @@ void DrawGame(Game game) {
             }
         }
         else {
-            sprintf(enemiesText, "Enemies: %d/%d", game.enemiesDefeated, game.enemiesToDefeat);
+            sprintf(enemiesText, "Enemies: %d/%d", game->enemiesDefeated, game->enemiesToDefeat);
         }
         DrawText(enemiesText, 10, 70, 24, DARKBLUE);
 
         char healthText[50];
-        sprintf(healthText, "Health: %d", game.player.health);
+        sprintf(healthText, "Health: %d", game->player.health);
         DrawText(healthText, WIDTH - 200, 10, 24, DARKBLUE);
 
-        if (game.player.hasKnifeBonus) {
+        if (game->player.hasKnifeBonus) {
             DrawText("KNIVES READY! PRESS RMB", WIDTH / 2 - 150, HEIGHT - 30, 20, RED);
         }
-        if (game.player.damageMultiplier > 1) {
+        if (game->player.damageMultiplier > 1) {
             DrawText("DAMAGE x2 ACTIVE!", WIDTH / 2 - 100, HEIGHT - 60, 20, GOLD);
         }
+        if (game->player.hasLaser) {
+            DrawText("LASER ACTIVE! HOLD LMB", WIDTH / 2 - 120, HEIGHT - 60, 20, MAGENTA);
+        }
 
-        DrawText("HOLD LMB - AUTO SHOOT", WIDTH - 200, HEIGHT - 30, 18, DARKBLUE);
-        DrawText("RMB - KNIVES", WIDTH - 150, HEIGHT - 60, 18, DARKBLUE);
+        // Подсказки управления - первое, что не нужно под нагрузкой
+        if (game->quality.tier < QUALITY_SIMPLE) {
+            DrawText("HOLD LMB - AUTO SHOOT", WIDTH - 200, HEIGHT - 30, 18, DARKBLUE);
+            DrawText("RMB - KNIVES", WIDTH - 150, HEIGHT - 60, 18, DARKBLUE);
+        }
+        DrawQualityIndicator(&game->quality);
 
-        if (game.level == 3 && game.bossSpawned) {
-            for (int i = 0; i < game.enemyCount; i++) {
-                if (game.enemies[i].isBoss) {
+        if (game->level == 3 && game->bossSpawned) {
+            for (int i = 0; i < game->enemyCount; i++) {
+                if (game->enemies[i].isBoss) {
                     DrawText("FINAL BOSS FIGHT!", WIDTH / 2 - 100, 100, 30, RED);
                     char bossHealth[50];
-                    sprintf(bossHealth, "BOSS HP: %d", game.enemies[i].health);
+                    sprintf(bossHealth, "BOSS HP: %d", game->enemies[i].health);
                     DrawText(bossHealth, WIDTH / 2 - 60, 130, 24, RED);
 
                     const char* patternText = "";
-                    switch (game.enemies[i].attackPattern) {
+                    switch (game->enemies[i].attackPattern) {
                     case 0: patternText = "WAVE ATTACK"; break;
                     case 1: patternText = "SPIRAL ATTACK"; break;
                     case 2: patternText = "TARGETED ATTACK"; break;
@@ -1416,80 +6377,280 @@ void DrawGame(Game game) {
             }
         }
 
+        if (game->profiler.showOverlay) {
+            DrawProfilerOverlay(&game->profiler, game->ai->budgetUs, game->particles);
+        }
+        if (game->latency.enabled) {
+            DrawLatencyOverlay(&game->latency);
+        }
+
     }
-    else if (strcmp(game.state, "level_complete") == 0) {
+    else if (strcmp(game->state, "level_complete") == 0) {
         DrawText("LEVEL COMPLETE!", WIDTH / 2 - 180, HEIGHT / 2 - 50, 40, GREEN);
 
         char levelText[50];
-        sprintf(levelText, "Level %d completed!", game.level);
+        sprintf(levelText, "Level %d completed!", game->level);
         DrawText(levelText, WIDTH / 2 - 120, HEIGHT / 2, 30, DARKBLUE);
 
         char scoreText[50];
-        sprintf(scoreText, "Score: %d", game.score);
+        sprintf(scoreText, "Score: %d", game->score);
         DrawText(scoreText, WIDTH / 2 - 60, HEIGHT / 2 + 50, 30, DARKBLUE);
 
     }
-    else if (strcmp(game.state, "game_over") == 0) {
+    else if (strcmp(game->state, "game_over") == 0) {
         DrawText("GAME OVER", WIDTH / 2 - 150, HEIGHT / 2 - 50, 50, RED);
 
         char scoreText[50];
-        sprintf(scoreText, "Final Score: %d", game.score);
+        sprintf(scoreText, "Final Score: %d", game->score);
         DrawText(scoreText, WIDTH / 2 - 120, HEIGHT / 2, 30, DARKBLUE);
 
         DrawText("Press ESC to return to menu", WIDTH / 2 - 180, HEIGHT / 2 + 100, 20, DARKBLUE);
 
     }
-    else if (strcmp(game.state, "victory") == 0) {
+    else if (strcmp(game->state, "victory") == 0) {
         DrawText("VICTORY!", WIDTH / 2 - 100, HEIGHT / 2 - 50, 60, GOLD);
 
         char scoreText[50];
-        sprintf(scoreText, "Final Score: %d", game.score);
+        sprintf(scoreText, "Final Score: %d", game->score);
         DrawText(scoreText, WIDTH / 2 - 100, HEIGHT / 2 + 30, 30, DARKBLUE);
 
         DrawText("You defeated the FINAL BOSS!", WIDTH / 2 - 180, HEIGHT / 2 + 80, 30, GREEN);
         DrawText("Press ESC to return to menu", WIDTH / 2 - 180, HEIGHT / 2 + 120, 20, DARKBLUE);
     }
+    EndMode2D();
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+    // --bench [кадры] [файл]: прогон 2 уровня с фиксированным сидом и отчётом в JSON
+    // --fps N: целевая частота кадров (бенчмарк без неё идёт без ограничения)
+    // --threads N: рабочие потоки планировщика (по умолчанию ядра - 1)
+    // --log файл: писать двоичный журнал в файл (без флага журнала нет)
+    // --null-audio: смешивать звук без устройства (бенчмарк всегда так)
+    // --decode-log [файл]: вывести двоичный журнал текстом и выйти (без файла - из --log)
+    // --render-scale F: внутреннее разрешение в долях WIDTH x HEIGHT
+    // --integer-scale: растягивать кадр в целое число раз без сглаживания
+    // --crowd N: N преследователей по всей арене в начале обычных уровней
+    bool bench = false;
+    int benchFrames = 1800;
+    const char* benchPath = "bench.json";
+    double targetFps = RENDER_FPS;
+    bool fpsGiven = false;
+    int workerCount = (int)std::thread::hardware_concurrency() - 1;
+    const char* logPath = NULL;
+    bool nullAudio = false;
+    float renderScale = 1.0f;
+    bool integerScale = false;
+    int crowd = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--bench") == 0) {
+            bench = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-') benchFrames = atoi(argv[++i]);
+            if (i + 1 < argc && argv[i + 1][0] != '-') benchPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+            targetFps = atof(argv[++i]);
+            fpsGiven = true;
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            workerCount = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--log") == 0 && i + 1 < argc) {
+            logPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--null-audio") == 0) {
+            nullAudio = true;
+        }
+        else if (strcmp(argv[i], "--render-scale") == 0 && i + 1 < argc) {
+            renderScale = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--integer-scale") == 0) {
+            integerScale = true;
+        }
+        else if (strcmp(argv[i], "--crowd") == 0 && i + 1 < argc) {
+            crowd = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--decode-log") == 0) {
+            const char* path = (i + 1 < argc) ? argv[i + 1] : logPath;
+            if (path == NULL) {
+                fprintf(stderr, "--decode-log needs a file\n");
+                return 1;
+            }
+            if (!DecodeLogFile(path, stdout)) {
+                fprintf(stderr, "Failed to decode %s\n", path);
+                return 1;
+            }
+            return 0;
+        }
+    }
+    if (targetFps <= 0) targetFps = RENDER_FPS;
+
+    if (logPath != NULL && !StartLogger(logPath)) {
+        printf("Failed to open %s, logging disabled\n", logPath);
+    }
+
+    // Окно можно растянуть: размер кадра от этого не меняется
+    SetConfigFlags(FLAG_WINDOW_RESIZABLE);
     InitWindow(WIDTH, HEIGHT, "Crazy Hatman - Controls: Arrows - Move, Hold LMB - Auto Shoot, RMB - Knives");
-    SetTargetFPS(60);
 
     Game game = CreateGame();
+    game.crowdSize = crowd < 0 ? 0 : (crowd > MAX_ENEMIES ? MAX_ENEMIES : crowd);
+
+    static JobSystem jobs;
+    InitJobSystem(&jobs, workerCount);
+    game.jobs = &jobs;
+    static CollisionBuffers collisionBuffers;
+    game.collision = &collisionBuffers;
+    static SeparationGrid separationGrid;
+    separationGrid.enabled = true;
+    game.separation = &separationGrid;
+    static EnemyIndex enemyIndex;
+    game.enemyIndex = &enemyIndex;
+    static ParticleSystem particleSystem;
+    InitParticleSystem(&particleSystem, MAX_PARTICLES);
+    game.particles = &particleSystem;
+    InitQualityGovernor(&game.quality, targetFps);
+    static Presenter presenter;
+    InitPresenter(&presenter, renderScale, integerScale);
+    game.present = &presenter;
+    static AiScheduler aiScheduler;
+    InitAiScheduler(&aiScheduler, AI_BUDGET_US);
+    game.ai = &aiScheduler;
+    static TimerWheel timerWheel;
+    InitTimerWheel(&timerWheel);
+    game.timers = &timerWheel;
+    static PatternLibrary patternLibrary;
+    CompilePatternLibrary(&patternLibrary);
+    game.patterns = &patternLibrary;
+    static FlowField flowField;
+    InitFlowField(&flowField);
+    game.flow = &flowField;
+
+    // Побочные системы читают события тика в своих потоках
+    static EventBus eventBus;
+    InitEventBus(&eventBus);
+    game.bus = &eventBus;
+    static EventConsumer logConsumer;
+    static EventConsumer statsConsumer;
+    static EventStats eventStats;
+    StartEventConsumer(&logConsumer, &eventBus, "log", LogEventHandler, NULL);
+    StartEventConsumer(&statsConsumer, &eventBus, "stats", StatsEventHandler, &eventStats);
+    game.consumers[game.consumerCount++] = &logConsumer;
+    game.consumers[game.consumerCount++] = &statsConsumer;
+    game.eventStats = &eventStats;
+
+    static AudioMixer audioMixer;
+    StartAudio(&audioMixer, nullAudio || bench);
+    game.audio = &audioMixer;
+
+    if (bench) {
+        SetRandomSeed(12345);
+        StartNewGame(&game);
+        StartNextLevel(&game);
+        game.benchMode = true;
+        // Бюджет по времени сделал бы прогон неповторяемым - в бенчмарке только лимит решений
+        aiScheduler.timeBudget = false;
+        game.profiler.showOverlay = true;
+        game.latency.enabled = true;
+    }
 
-    while (!WindowShouldClose()) {
-        if (strcmp(game.state, "menu") == 0) {
-            UpdateButton(&game.newGameButton);
-            UpdateButton(&game.continueButton);
-            UpdateButton(&game.quitButton);
+    // Ввод снимается чаще кадров и разбирается по тикам по меткам времени
+    static InputQueue inputQueue;
+    InitInputQueue(&inputQueue);
+    SampleInput(&inputQueue);
 
-            if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON)) {
-                if (IsButtonHovered(game.newGameButton)) {
-                    StartNewGame(&game);
-                }
-                else if (IsButtonHovered(game.quitButton)) {
-                    break;
-                }
-            }
+    FramePacer pacer;
+    InitFramePacer(&pacer, targetFps, &game.profiler.pacing);
+    bool paced = !bench || fpsGiven;
+
+    double nextTickTime = GetTime() + SIM_DT;  // Конец следующего тика
+    bool running = true;
+    int frame = 0;
+    while (running && !WindowShouldClose()) {
+        if (game.benchMode && frame >= benchFrames) {
+            break;
         }
-        else if (strcmp(game.state, "playing") == 0) {
-            if (IsKeyPressed(KEY_ESCAPE)) {
-                strcpy(game.state, "menu");
-            }
+
+        // Симуляция с фиксированным шагом; в бенчмарке ровно один тик на кадр
+        double now = GetTime();
+        double frameStart = now;
+        if (now - nextTickTime > SIM_MAX_CATCHUP * SIM_DT) {
+            nextTickTime = now - SIM_MAX_CATCHUP * SIM_DT;
         }
-        else if (strcmp(game.state, "game_over") == 0 || strcmp(game.state, "victory") == 0) {
-            if (IsKeyPressed(KEY_ESCAPE)) {
-                strcpy(game.state, "menu");
-            }
+        if (game.benchMode) {
+            nextTickTime = now;
         }
+        while (nextTickTime <= now) {
+            TickInput input = ReadTickInput(&inputQueue, nextTickTime);
+            nextTickTime += SIM_DT;
+
+            if (!HandleStateInput(&game, &input)) {
+                running = false;
+                break;
+            }
+            if (game.benchMode) {
+                // Игрок бессмертен, чтобы волна копилась до конца прогона
+                game.player.invincible = true;
+            }
 
-        UpdateGame(&game);
+            double tickStart = GetTime();
+            UpdateGame(&game, &input);
+            PublishGameEvents(&game);
+            QueueGameSounds(&game);
+            ProfilerEndTick(&game.profiler, GetTime() - tickStart);
+            // Без пейсера ждать некогда - опрашиваем между тиками и после отрисовки
+            if (!paced) {
+                PollAndSampleInput(&inputQueue);
+            }
+        }
 
+        // Доля следующего тика, прошедшая с конца последнего отработанного
+        float alpha = game.benchMode ? 1.0f : (float)((GetTime() - (nextTickTime - SIM_DT)) / SIM_DT);
+        if (alpha < 0) alpha = 0.0f;
+        if (alpha > 1) alpha = 1.0f;
+
+        UpdatePresenter(&presenter, game.quality.tier);
+        BeginTextureMode(presenter.target);
+        DrawGame(&game, alpha);
+        EndTextureMode();
+        if (!paced) {
+            PollAndSampleInput(&inputQueue);
+        }
         BeginDrawing();
-        DrawGame(game);
+        PresentFrame(&presenter);
+        if (game.latency.enabled) {
+            LatencyPresent(&game.latency);
+        }
         EndDrawing();
+        SampleInput(&inputQueue);
+        UpdateQualityGovernor(&game.quality, game.particles, GetTime() - frameStart);
+
+        if (paced) {
+            WaitForNextFrame(&pacer, &inputQueue, &game.profiler.pacing);
+        }
+
+        ProfilerEndFrame(&game.profiler);
+        frame++;
+    }
+
+    // Подписчики дочитывают хвост шины до записи отчёта
+    for (int c = 0; c < game.consumerCount; c++) {
+        StopEventConsumer(game.consumers[c]);
+    }
+    StopAudio(&audioMixer);
+
+    if (game.benchMode) {
+        MeasureRaycast(&game.raycastBench);
+        MeasureQueries(&game.queryBench);
+        MeasureParticles(&game.particleBench);
+        MeasureFlowField(&game.flowBench);
+        if (!WriteBenchmarkJson(&game, benchPath)) {
+            printf("Failed to write %s\n", benchPath);
+        }
     }
 
+    UnloadPresenter(&presenter);
+    ShutdownJobSystem(&jobs);
+    StopLogger();
     CloseWindow();
     return 0;
 }
\ No newline at end of file
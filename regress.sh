@@ -0,0 +1,59 @@
+#!/bin/sh
+# Регрессия по --bench: ./regress.sh путь/к/игре [кадры]
+#
+# Каждый прогон идёт с фиксированным сидом. Проверяется:
+#  - state_hash одинаков при 0, 4 и 8 рабочих потоках, с толпой и без;
+#  - лучи и запросы к индексу врагов совпадают с перебором (0 расхождений).
+# Игре нужен дисплей; без него запускать через xvfb-run.
+# Код возврата 0 - всё сошлось, 1 - есть расхождения.
+
+GAME=${1:?usage: regress.sh path/to/game [frames]}
+FRAMES=${2:-3000}
+WORK=$(mktemp -d) || exit 1
+trap 'rm -rf "$WORK"' EXIT
+FAILED=0
+
+# Число из плоского поля JSON: field файл
+field() {
+    grep -o "\"$1\": *\"*[0-9a-f.]*" "$2" | head -n 1 | sed 's/.*: *"*//'
+}
+
+fail() {
+    echo "FAIL: $*"
+    FAILED=1
+}
+
+for CROWD in 0 450; do
+    HASH=
+    for THREADS in 0 4 8; do
+        OUT="$WORK/bench_${CROWD}_${THREADS}.json"
+        if ! "$GAME" --bench "$FRAMES" "$OUT" --threads "$THREADS" --crowd "$CROWD" >/dev/null 2>&1 || [ ! -s "$OUT" ]; then
+            fail "crowd $CROWD, threads $THREADS: bench did not write a report"
+            continue
+        fi
+        CURRENT=$(field state_hash "$OUT")
+        echo "crowd $CROWD, threads $THREADS: state_hash $CURRENT"
+        if [ -z "$HASH" ]; then
+            HASH=$CURRENT
+        elif [ "$CURRENT" != "$HASH" ]; then
+            fail "crowd $CROWD, threads $THREADS: state_hash $CURRENT, expected $HASH"
+        fi
+    done
+done
+
+# Сверка с перебором не зависит от прогона - хватает одного отчёта
+OUT="$WORK/bench_0_0.json"
+if [ -s "$OUT" ]; then
+    for NAME in mismatches radius_mismatches nearest_mismatches cone_mismatches; do
+        COUNT=$(field "$NAME" "$OUT")
+        echo "$NAME: $COUNT"
+        if [ "$COUNT" != "0" ]; then
+            fail "$NAME is $COUNT"
+        fi
+    done
+fi
+
+if [ "$FAILED" -ne 0 ]; then
+    exit 1
+fi
+echo "OK"